@@ -0,0 +1,48 @@
+#ifndef GAME
+#define GAME
+#include "game.h"
+#endif
+
+#define AGENTS_PER_JOB 256  // the number of agents each thread pool job moves
+#define MAX_SLIDES 10  // the number of times an agent slides along walls in a tick before it gives up
+#define PORTAL_EDGE 0.005  // the fraction of a portal at each end that agents cannot squeeze through
+#define WALL_MARGIN 0.001  // how far behind the line of a wall, in metres, an agent still counts as on it
+
+struct pool;
+
+/**
+ * A batch of agents, such as NPCs, that walk around the map like the camera does. The agents are
+ * stored as a structure of arrays, so that each field is read from memory in order.
+ *
+ * @param n_agents: The number of agents.
+ * @param x: The x coordinate of the position of each agent.
+ * @param y: The y coordinate of the position of each agent.
+ * @param vx: The x component of the velocity of each agent, in metres per second.
+ * @param vy: The y component of the velocity of each agent, in metres per second.
+ * @param sector: The sector each agent is in, or 0 for an agent outside the map, which is not moved.
+ */
+struct agents {
+    int n_agents;
+    float *x;
+    float *y;
+    float *vx;
+    float *vy;
+    int *sector;
+};
+
+/**
+ * Move every agent along its velocity for one tick, with the rules the camera walks by. An agent
+ * that walks into a wall slides along it, and one that walks into a portal crosses into the next
+ * sector if it can step up or down into it and stand up in it. The agents are moved in parallel on
+ * the thread pool, and the path of each is tested against several walls of the outline of its
+ * sector at once in a vector. The velocities are left as they are.
+ *
+ * As with the camera, an agent crosses at most one portal per tick, so the step of an agent in a
+ * tick should be shorter than the sectors it walks through are deep.
+ *
+ * @param world: The map data.
+ * @param pool: The thread pool, or NULL to move the agents on the calling thread.
+ * @param agents: The agents.
+ * @param dt: The length of the tick in seconds.
+ */
+void move_agents(const struct world *world, struct pool *pool, struct agents *agents, const float dt);
@@ -0,0 +1,143 @@
+#ifndef GAME
+#define GAME
+#include "game.h"
+#endif
+#ifndef PALETTE
+#define PALETTE
+#include "palette.h"
+#endif
+#include <pthread.h>
+
+#define TEXTURE_FALLBACK 0.5f  // the grey drawn for a texture that has never been loaded
+
+struct manifest;
+
+/**
+ * The residency of a texture in the texture cache.
+ *
+ * TEXTURE_EVICTED: The texels are not in memory.
+ * TEXTURE_LOADING: The texture has been requested and is being loaded on the background thread.
+ * TEXTURE_RESIDENT: The texels are in memory.
+ * TEXTURE_MISSING: The texture failed to load, and is always drawn in its fallback colour.
+ */
+enum residency {
+    TEXTURE_EVICTED,
+    TEXTURE_LOADING,
+    TEXTURE_RESIDENT,
+    TEXTURE_MISSING
+};
+
+/**
+ * Keeps the textures used by recent frames resident within a memory budget. Textures are loaded
+ * on a background thread the first time a frame sees them, and the least recently used textures
+ * are evicted when the budget is exceeded. Textures only change residency between frames, so the
+ * renderer never waits for one: until a texture arrives, it is drawn in its fallback colour.
+ *
+ * @param n_textures: The number of textures.
+ * @param paths: The filepath of each texture.
+ * @param budget: The number of bytes of texels kept resident.
+ * @param resident: The number of bytes of texels resident.
+ * @param frame: The number of frames started.
+ * @param state: The residency of each texture.
+ * @param sizes: The number of bytes of texels of each resident texture, including its mip levels.
+ * @param last_used: The frame in which each texture was last seen.
+ * @param palette: The palette that loaded textures are quantised to, or NULL. It is set before
+ *                 the first texture is requested.
+ * @param thread: The background thread.
+ * @param lock: The lock protecting the fields below.
+ * @param work: Signalled when a texture is requested or the cache is stopping.
+ * @param stopping: Whether the background thread should exit.
+ * @param head: The index of the oldest request in the request queue.
+ * @param n_requests: The number of requested textures waiting to be loaded.
+ * @param requests: The request queue, a ring of texture ids. Each texture is queued at most once.
+ * @param n_loaded: The number of textures loaded but not yet made resident.
+ * @param loaded_ids: The ids of the loaded textures.
+ * @param loaded: The loaded textures, or NULL for those that failed to load.
+ */
+struct texture_cache {
+    int n_textures;
+    char **paths;
+    size_t budget;
+    size_t resident;
+    unsigned long frame;
+    enum residency *state;
+    size_t *sizes;
+    unsigned long *last_used;
+    const struct palette *palette;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    bool stopping;
+    int head;
+    int n_requests;
+    int *requests;
+    int n_loaded;
+    int *loaded_ids;
+    texture *loaded;
+};
+
+/**
+ * Create a texture cache for the textures listed in an asset manifest and start its background
+ * thread. The textures are taken out of the manifest, so `load_assets()` leaves them unloaded.
+ *
+ * @param manifest: The asset manifest.
+ * @param budget: The number of bytes of texels kept resident.
+ * @return A pointer to a heap allocated texture cache.
+ */
+struct texture_cache *create_texture_cache(struct manifest *manifest, const size_t budget);
+
+/**
+ * Give every texture of a newly loaded world an empty texture to be filled in by the cache.
+ *
+ * @param cache: The texture cache.
+ * @param world: The world, whose texture array was left empty by `load_assets()`.
+ */
+void attach_texture_cache(struct texture_cache *cache, struct world *world);
+
+/**
+ * Load every texture on the calling thread, ignoring the budget until the next frame. Used to
+ * build a palette from all of the textures.
+ *
+ * @param cache: The texture cache.
+ * @param world: The world.
+ */
+void load_all_textures(struct texture_cache *cache, struct world *world);
+
+/**
+ * Make a loaded texture resident, replacing the texels it had.
+ *
+ * @param cache: The texture cache.
+ * @param world: The world.
+ * @param id: The id of the texture.
+ * @param loaded: The loaded texture, whose texels are moved into the world's texture.
+ */
+void install_texture(struct texture_cache *cache, struct world *world, const int id, texture loaded);
+
+/**
+ * Start a frame: make the textures loaded since the last frame resident, then evict the least
+ * recently used textures that the last frame did not see until the cache is within its budget.
+ * The world must not be rendered while this runs.
+ *
+ * @param cache: The texture cache.
+ * @param world: The world.
+ */
+void update_textures(struct texture_cache *cache, struct world *world);
+
+/**
+ * Mark the textures of the walls, flats and entities in the sectors seen by a frame as used, requesting
+ * those that are not resident.
+ *
+ * @param cache: The texture cache.
+ * @param world: The world.
+ * @param visible: The ids of the sectors seen by the frame.
+ * @param n_visible: The number of sectors seen by the frame.
+ */
+void touch_textures(struct texture_cache *cache, const struct world *world, const int *visible, const int n_visible);
+
+/**
+ * Stop the background thread and deallocate the texture cache. The textures in the world are
+ * deallocated with the world.
+ *
+ * @param cache: The texture cache.
+ */
+void destroy_texture_cache(struct texture_cache *cache);
@@ -0,0 +1,61 @@
+#ifndef GAME
+#define GAME
+#include "game.h"
+#endif
+#ifndef GRAPHICS
+#define GRAPHICS
+#include "graphics.h"
+#endif
+
+#define MIN_RES_SCALE 0.25f  // the smallest fraction of the window resolution rendered
+#define RES_GAIN 0.5f  // how quickly the resolution scale approaches its ideal value
+#define RES_DEADBAND 0.02f  // relative scale changes smaller than this are ignored
+
+/**
+ * The dynamic resolution controller. Scales the number of columns and rows rendered each
+ * frame so that the time spent rendering stays close to a target frame time.
+ *
+ * @param max_width: The number of columns rendered at full resolution.
+ * @param max_height: The number of rows rendered at full resolution.
+ * @param scale: The current fraction of the full resolution rendered along each axis.
+ * @param target: The target frame time in seconds. If this is not positive, the resolution
+ *                is fixed at the full resolution.
+ */
+struct resolution {
+    int max_width, max_height;
+    float scale;
+    double target;
+};
+
+/**
+ * Initialise the dynamic resolution controller and size the framebuffer to the full resolution.
+ *
+ * @param res: The resolution controller.
+ * @param fb: The framebuffer, which must hold at least width * height pixels.
+ * @param width: The full resolution width.
+ * @param height: The full resolution height.
+ * @param target: The target frame time in seconds, or 0 to disable dynamic resolution.
+ */
+void init_resolution(struct resolution *res, struct framebuffer *fb, const int width, const int height, const double target);
+
+/**
+ * Adjust the internal resolution for the next frame from the time taken to render the last one.
+ * Render cost is proportional to the number of pixels, so the scale along each axis is moved
+ * by the square root of the ratio between the target and the measured frame time.
+ *
+ * @param res: The resolution controller.
+ * @param fb: The framebuffer whose width and height are updated.
+ * @param frame_time: The time taken to render the last frame, in seconds.
+ */
+void scale_resolution(struct resolution *res, struct framebuffer *fb, const double frame_time);
+
+/**
+ * Draw the framebuffer to the current OpenGL context, upscaling it to fill the window. Indexed
+ * frames are expanded to RGB first.
+ *
+ * @param fb: The framebuffer.
+ * @param palette: The palette of an indexed frame, or NULL if the frame is RGB.
+ * @param window_width: The width of the window's framebuffer in pixels.
+ * @param window_height: The height of the window's framebuffer in pixels.
+ */
+void present(const struct framebuffer *fb, const struct palette *palette, const int window_width, const int window_height);
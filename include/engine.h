@@ -0,0 +1,140 @@
+#ifndef GAME
+#define GAME
+#include "game.h"
+#endif
+#ifndef GRAPHICS
+#define GRAPHICS
+#include "graphics.h"
+#endif
+#ifndef LOAD
+#define LOAD
+#include "load.h"
+#endif
+#ifndef WORLD
+#define WORLD
+#include "world.h"
+#endif
+#ifndef SPRITES
+#define SPRITES
+#include "sprites.h"
+#endif
+#ifndef CACHE
+#define CACHE
+#include "cache.h"
+#endif
+
+#define BANDS_PER_THREAD 4  // the number of column bands each thread renders per frame
+#define DAMAGE_NEAR 0.01  // damaged areas closer to the camera than this redraw every column
+
+/**
+ * The buffers used to render one view, kept from frame to frame.
+ *
+ * @param columns: The column buffer that the walls record into.
+ * @param sprites: The sprites found in the view.
+ * @param valid: Whether the last frame of the view can be reused by the next one.
+ * @param camera: The camera of the last frame.
+ * @param pos: The position of the camera of the last frame.
+ * @param fb: The framebuffer of the last frame.
+ * @param options: The render options of the last frame.
+ * @param dirty: Whether each column of the frame being rendered is rendered again, rather than
+ *               kept from the last frame.
+ */
+struct view {
+    struct column_buffer columns;
+    struct sprite_set *sprites;
+    bool valid;
+    struct camera camera;
+    struct vec2 pos;
+    struct framebuffer fb;
+    struct render_options options;
+    bool *dirty;
+};
+
+/**
+ * A renderer context. Loads a level once and renders any number of views of it. The map data is
+ * only read while rendering, so many views can be rendered at once.
+ *
+ * @param world: The map data. It may be animated between frames with the world module, followed by
+ *               `update_world()` before the next frame is rendered.
+ * @param options: The render options, which may be changed between frames. The indexed output
+ *                 style can only be used if it was selected when the context was created.
+ * @param palette: The palette of the indexed output style, or NULL if it is not used.
+ * @param pool: The thread pool that frames are rendered on.
+ * @param textures: The texture cache, or NULL if every texture is resident. A context has a cache
+ *                  if it was created with a texture budget.
+ * @param n_views: The number of views that buffers have been allocated for.
+ * @param views: The buffers of each view rendered at once.
+ * @param n_assets: The number of assets the level was loaded from.
+ * @param load_time: The time taken to load the assets of the level, in seconds.
+ */
+struct engine {
+    struct world world;
+    struct render_options options;
+    struct palette *palette;
+    struct pool *pool;
+    struct texture_cache *textures;
+    int n_views;
+    struct view *views;
+    int n_assets;
+    double load_time;
+};
+
+/**
+ * Create a renderer context and load the level listed in the given asset manifest.
+ *
+ * @param manifest_path: The filepath of the asset manifest.
+ * @param options: The render options.
+ * @param n_threads: The number of threads used to render, or 0 for one thread per core.
+ * @return A pointer to a heap allocated renderer context, or NULL if the level failed to load.
+ */
+struct engine *create_engine(const char *manifest_path, const struct render_options *options, const int n_threads);
+
+/**
+ * Place a camera in the level, standing on the floor of the given sector.
+ *
+ * @param engine: The renderer context.
+ * @param camera: The camera.
+ * @param pos: The position of the camera, which is referenced rather than copied.
+ * @param angle: The camera angle in radians.
+ * @param sector: The sector the camera is in.
+ */
+void place_camera(const struct engine *engine, struct camera *camera, struct vec2 *pos, const float angle, const int sector);
+
+/**
+ * Render a view of the level into a caller-owned framebuffer. The columns of the frame are split
+ * into bands rendered in parallel on the context's thread pool. The walls are drawn first, then
+ * the textured floors and ceilings of each band row by row, then the sprites of the entities in
+ * the sectors that were seen, back to front. With a texture cache,
+ * the textures loaded since the last frame are made resident first, and the textures the frame
+ * saw are requested after.
+ *
+ * With incremental frames, a frame from the same camera into the same framebuffer as the last
+ * one only renders the columns that see something the changes to the world since have damaged,
+ * and renders nothing at all if there were none.
+ *
+ * @param engine: The renderer context.
+ * @param camera: The camera to render from.
+ * @param fb: The framebuffer. Its `pixels`, or `indices` for the indexed output style, must hold
+ *            `width * height` pixels.
+ * @return The number of columns rendered.
+ */
+int render_frame(struct engine *engine, const struct camera *camera, struct framebuffer *fb);
+
+/**
+ * Render many views of the level at once, each into its own caller-owned framebuffer. The views
+ * are rendered in parallel on the context's thread pool, one view per job. Each view is rendered
+ * incrementally like `render_frame()`.
+ *
+ * @param engine: The renderer context.
+ * @param cameras: The cameras to render from.
+ * @param fbs: The framebuffers, one per camera.
+ * @param n_views: The number of views.
+ */
+void render_batch(struct engine *engine, const struct camera *cameras, struct framebuffer *fbs, const int n_views);
+
+/**
+ * Deallocate the renderer context and the level it loaded.
+ *
+ * @param engine: The renderer context.
+ */
+void destroy_engine(struct engine *engine);
@@ -1,24 +1,25 @@
-#define GL_SILENCE_DEPRECATION
-#include <GLFW/glfw3.h>
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <stdbool.h>
+#ifndef FIXED
+#define FIXED
+#include "fixed.h"
+#endif
 
 #define FUDGE (1e-6)  // fudge factor to avoid floating point errors
+#define min(a, b) (a < b ? a : b)
+#define max(a, b) (a < b ? b : a)
 
-#define SCR_WIDTH (640)  // screen width
-#define SCR_HEIGHT (480)  // screen height
-#define RATIO ((float) SCR_HEIGHT / (float) SCR_WIDTH)  // the aspect ratio
+#define DEFAULT_WIDTH (640)  // default window width, overridden on the command line
+#define DEFAULT_HEIGHT (480)  // default window height, overridden on the command line
 
 #define ROTSPD (2.0f * 0.016f)  // camera rotating speed
 #define MVTSPD (1.5f * 0.016f)  // movement speed
 #define CAM_Z (1.70)  // the default height of the camera
+#define WALL_LANES 4  // the outline of a sector is padded to a multiple of this many walls, tested together in a vector
 
-#define TEX_WIDTH (128)  // texture width
-#define TEX_HEIGHT (128)  // texture height
 #define TEX_WIDTH_DENSITY 1  // how much of the texture width is displayed per metre
 #define TEX_HEIGHT_DENSITY 1  // how much of the texture height is displayed per metre
 
@@ -57,21 +58,99 @@ struct rgb {
     float b;
 };
 
-typedef struct rgb **texture;
+/**
+ * A texture, stored row by row from the bottom of the image.
+ * 
+ * @param width: The width of the texture in texels.
+ * @param height: The height of the texture in texels.
+ * @param texels: The colours of the texels, or NULL if the texture is not resident in the
+ *                texture cache.
+ * @param indices: The palette indices of the texels, or NULL if the texture has not been quantised.
+ * @param fallback: The average colour of the texture, drawn instead while it is not resident.
+ * @param fallback_index: The palette index of the fallback colour.
+ * @param n_mips: The number of mip levels below the full size texture.
+ * @param mips: The mip levels, each half the size of the one before, down to a single texel.
+ */
+struct texture {
+    int width;
+    int height;
+    struct rgb *texels;
+    unsigned char *indices;
+    struct rgb fallback;
+    unsigned char fallback_index;
+    int n_mips;
+    struct texture *mips;
+};
+
+typedef struct texture *texture;
+
+// sprite texels in the colour key, magenta, are transparent
+#define TRANSPARENT(colour) ((colour)->r == 1.0f && (colour)->g == 0.0f && (colour)->b == 1.0f)
 
 /**
- * A wall of the map.
+ * The part of a wall that a light reaches. Lights are traced through the portals, so a wall only
+ * lit from behind the solid walls of other sectors has no span for the light.
+ *
+ * @param light: The id of the light.
+ * @param s0: The start of the lit part, as a fraction of the wall from its starting endpoint.
+ * @param s1: The end of the lit part, as a fraction of the wall from its starting endpoint.
+ */
+struct lit_span {
+    int light;
+    float s0;
+    float s1;
+};
+
+/**
+ * A wall of the map. The fields after `texture_id` are derived from the map and kept up to date
+ * by the world module.
  * 
  * @param start: The starting endpoint of the wall.
  * @param end: The ending endpoint of the wall.
  * @param portal: The sector that this portal leads to. If this is not
  *                a portal, its value will be -1.
  * @param texture_id: The id of the wall texture.
+ * @param sector: The sector that the wall belongs to.
+ * @param normal: The clockwise unit normal of the wall.
+ * @param length: The length of the wall, approximated with the alpha max plus beta min algorithm.
+ * @param fixed_start: The starting endpoint in fixed point, for the fixed point renderer.
+ * @param fixed_dir: The vector from the starting to the ending endpoint in fixed point.
+ * @param lights: The parts of the wall reached by each light that can see it, in order of light.
+ *                A light that reaches the wall through several portals has a span for each.
+ * @param n_lights: The number of lit spans.
+ * @param max_lights: The number of lit spans there is room for.
+ * @param passable: Whether the camera can walk through the portal into the next sector.
+ * @param dirty: Whether the wall is queued to have its derived fields rebuilt.
  */
 struct wall {
-    struct vec2i *start, *end;
+    struct vec2 *start, *end;
     int portal;
     int texture_id;
+    int sector;
+    struct vec2 normal;
+    float length;
+    struct fixed_vec2 fixed_start, fixed_dir;
+    struct lit_span *lights;
+    int n_lights;
+    int max_lights;
+    bool passable;
+    bool dirty;
+};
+
+/**
+ * A wall endpoint. Every wall stores its own copy of its endpoints, so the vertex keeps track of
+ * the copies to move them as one.
+ * 
+ * @param pos: The position of the vertex.
+ * @param n_walls: The number of wall endpoints at the vertex.
+ * @param walls: The walls that start or end at the vertex.
+ * @param endpoints: The endpoint of each of those walls that lies at the vertex.
+ */
+struct vertex {
+    struct vec2 pos;
+    int n_walls;
+    struct wall **walls;
+    struct vec2 **endpoints;
 };
 
 /**
@@ -84,6 +163,27 @@ struct wall {
  * @param ceil_z: The height of the ceiling.
  * @param floor_colour: The colour of the sector floor.
  * @param ceil_colour: The colour of the sector ceiling.
+ * @param floor_index: The palette index of the floor colour.
+ * @param ceil_index: The palette index of the ceiling colour.
+ * @param floor_texture: The id of the floor texture, or -1 if the floor is drawn in its colour.
+ * @param ceil_texture: The id of the ceiling texture, or -1 if the ceiling is drawn in its colour.
+ * @param n_entries: The number of portals leading into this sector.
+ * @param entries: The portal walls of the neighbouring sectors that lead into this sector.
+ *                 Derived from the map.
+ * @param n_outline: The number of walls in the outline, rounded up to a multiple of WALL_LANES.
+ * @param outline: The x and the y of the starting endpoints of the walls, then the x and the y of
+ *                 their directions, as four arrays of `n_outline` floats, so that a path can be
+ *                 tested against several walls at once. The padding walls have no length, so
+ *                 nothing crosses them. Derived from the map.
+ * @param dirty: Whether the sector is queued to have the portals in and out of it rebuilt.
+ * @param damaged: Whether the sector is queued to be redrawn by the next frame.
+ * @param n_entities: The number of entities in this sector.
+ * @param max_entities: The number of entities that `entities` has room for.
+ * @param entities: The ids of the entities in this sector, in no particular order.
+ * @param n_lights: The number of lights traced into this sector.
+ * @param max_lights: The number of lights that `lights` has room for.
+ * @param lights: The ids of the lights traced into this sector, in no particular order. Derived
+ *                from the map.
  */
 struct sector {
     int id;
@@ -93,6 +193,22 @@ struct sector {
     float ceil_z;
     struct rgb *floor_colour;
     struct rgb *ceil_colour;
+    unsigned char floor_index;
+    unsigned char ceil_index;
+    int floor_texture;
+    int ceil_texture;
+    int n_entries;
+    struct wall **entries;
+    int n_outline;
+    float *outline;
+    bool dirty;
+    bool damaged;
+    int n_entities;
+    int max_entities;
+    int *entities;
+    int n_lights;
+    int max_lights;
+    int *lights;
 };
 
 /**
@@ -100,10 +216,83 @@ struct sector {
  * 
  * @param pos: The position of the light in world coordinates.
  * @param intensity: The intensity of the light, between 0.0 and 1.0.
+ * @param dirty: Whether the light is queued to have the walls it lights rebuilt and redrawn.
+ * @param sector: The sector the light is in, or 0 if it is outside the map. Derived from the map.
+ * @param n_walls: The number of walls the light has lit spans on.
+ * @param max_walls: The number of walls that `walls` has room for.
+ * @param walls: The walls the light has lit spans on, so that its spans are removed without
+ *               searching the map. Derived from the map.
+ * @param n_sectors: The number of sectors the light is traced into.
+ * @param max_sectors: The number of sectors that `sectors` has room for.
+ * @param sectors: The sectors the light is traced into, starting with its own. Only a change to
+ *                 the walls of these sectors can change what the light reaches. Derived from the map.
  */
 struct light {
     struct vec2 *pos;
     float intensity;
+    bool dirty;
+    int sector;
+    int n_walls;
+    int max_walls;
+    struct wall **walls;
+    int n_sectors;
+    int max_sectors;
+    int *sectors;
+};
+
+/**
+ * A billboarded entity, such as a pickup or an NPC, standing on the floor of its sector. It is
+ * drawn with a sprite that always faces the camera.
+ * 
+ * @param pos: The position of the entity in world coordinates.
+ * @param sector: The sector the entity is in, or 0 if it is outside the map.
+ * @param width: The width of the sprite in world units.
+ * @param height: The height of the sprite in world units.
+ * @param texture_id: The id of the sprite texture.
+ * @param slot: The index of the entity in the entity list of its sector.
+ */
+struct entity {
+    struct vec2 pos;
+    int sector;
+    float width;
+    float height;
+    int texture_id;
+    int slot;
+};
+
+/**
+ * The data of a loaded map, shared read-only by everything that renders it.
+ * 
+ * @param sectors: The array of sectors, indexed from 1.
+ * @param n_sectors: The number of sectors.
+ * @param textures: The array of textures, indexed by texture id.
+ * @param n_textures: The number of textures.
+ * @param lights: The array of lights.
+ * @param n_lights: The number of lights.
+ * @param entities: The array of entities.
+ * @param n_entities: The number of entities.
+ * @param vertices: The distinct wall endpoints. Derived from the map.
+ * @param n_vertices: The number of distinct wall endpoints.
+ * @param texture_starts: For each texture id, where its sectors start in `texture_sectors`, and
+ *                        then where the last of them end. Derived from the map.
+ * @param texture_sectors: The sectors with walls, a floor or a ceiling drawn with each texture,
+ *                         grouped by texture id. Derived from the map.
+ * @param changes: The changes made since the derived data was last updated.
+ */
+struct world {
+    struct sector **sectors;
+    int n_sectors;
+    texture *textures;
+    int n_textures;
+    struct light **lights;
+    int n_lights;
+    struct entity *entities;
+    int n_entities;
+    struct vertex *vertices;
+    int n_vertices;
+    int *texture_starts;
+    int *texture_sectors;
+    struct changes *changes;
 };
 
 /**
@@ -122,13 +311,15 @@ struct camera {
     float angle, anglecos, anglesin, height;
 };
 
+struct GLFWwindow;
+
 /**
  * Process the inputs of the user and perform different actions based on them.
  * 
  * @param window: A pointer to the GLFW window struct.
  * @param camera: A pointer to the camera struct.
  */
-void process_input(GLFWwindow *window, 
+void process_input(struct GLFWwindow *window, 
                    struct camera *camera, 
                    struct sector **sectors,
                    struct vec2 *new);
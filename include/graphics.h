@@ -2,10 +2,12 @@
 #define GAME
 #include "game.h"
 #endif
+#ifndef PALETTE
+#define PALETTE
+#include "palette.h"
+#endif
 
 #define PI 3.1415627f
-#define min(a, b) (a < b ? a : b)
-#define max(a, b) (a < b ? b : a)
 
 // constants for the alpha max plus beta min algorithm
 // https://en.wikipedia.org/wiki/Alpha_max_plus_beta_min_algorithm
@@ -13,16 +15,21 @@
 #define BETA 0.397824734759
 
 #define FOCAL_LEN 1  // the distance from the camera to the image plane, in game units
-#define WORLD2CAM(x) (-1 + (2 * (x + 0.5)) / SCR_WIDTH)  // transformation from world plane to image plane
+#define WORLD2CAM(x, width) (-1 + (2 * (x + 0.5)) / (width))  // transformation from world plane to image plane
 
 #define EDGE_LIM 0.01  // limit for edge detection
 #define AMBIENT 0.0  // the ambient light intensity value
 #define SHADING_FAC 0.25  // determines floor/ceiling intensity per sector distance
+#define MAX_PORTAL_DEPTH 64  // the default maximum number of portals traversed per column
+#define FOG_START 0.5  // the fraction of the view distance at which the fog starts
 
-#define BAYER  // whether to apply the dithering filter
 #define BAYER_NUM 8  // the size of the bayer matrix
 #define BAYER_SENS 0.5  // determines the amount of light and dark contrast in the dithering filter
 
+#define SPRITE_NEAR 0.1  // sprites closer to the camera than this are not drawn
+#define PLANE_FRAC_BITS 16  // the fractional bits of the fixed point texture coordinates of flats
+#define FIXED_NEAR (FIXED_ONE / 64)  // the fixed point renderer projects closer walls as if at this depth
+
 /**
  * Return the dot product between the vectors a and b.
  */
@@ -32,13 +39,181 @@ float dot(const struct vec2 *a, const struct vec2 *b);
  * https://en.wikipedia.org/wiki/Fast_inverse_square_root
  * 
  * The fast inverse square root algorithm from Quake III. Directly
- * copied from wikipedia except the type of i is changed from `long` to `int`.
+ * copied from wikipedia except the type of i is changed from `long` to `int`, and the
+ * pointer casts are replaced with a union so it is safe to compile with optimisations.
  * 
  * @param number: A number.
  * @return The inverse square root of the number.
  */
 float Q_rsqrt(const float number);
 
+/**
+ * Return a normalised version of the given vector v.
+ */
+struct vec2 normalise(const struct vec2 *v);
+
+/**
+ * The pixel buffer that a frame is rendered into. The resolution is chosen at runtime and may
+ * change between frames, so the buffer must be large enough for the biggest resolution used.
+ * 
+ * @param width: The number of columns rendered.
+ * @param height: The number of rows rendered.
+ * @param pixels: The RGB pixel data, stored row by row from the bottom of the screen.
+ * @param indices: The palette indices of the pixels, used instead of `pixels` by the indexed
+ *                 output style. Expanded to RGB when the frame is presented.
+ */
+struct framebuffer {
+    int width;
+    int height;
+    float *pixels;
+    unsigned char *indices;
+};
+
+/**
+ * The style in which frames are drawn.
+ * 
+ * OUTPUT_DITHER: Walls are drawn in two colours with the ordered dithering filter applied.
+ * OUTPUT_COLOUR: Walls are drawn in full colour.
+ * OUTPUT_INDEXED: Walls are drawn with 8-bit palette indices, shaded with the palette's shade tables.
+ */
+enum output_mode {
+    OUTPUT_DITHER,
+    OUTPUT_COLOUR,
+    OUTPUT_INDEXED
+};
+
+/**
+ * The lighting model applied to walls.
+ * 
+ * LIGHTING_LAMBERTIAN: Walls are shaded by the lights in the map using the Lambertian model.
+ * LIGHTING_FULLBRIGHT: Walls are drawn at full intensity and the shading model is skipped.
+ */
+enum lighting_mode {
+    LIGHTING_LAMBERTIAN,
+    LIGHTING_FULLBRIGHT
+};
+
+/**
+ * The runtime options of the renderer.
+ * 
+ * @param output: The output style.
+ * @param lighting: The lighting model.
+ * @param max_portal_depth: The maximum number of portals traversed per column. Sectors behind
+ *                          deeper portals are culled.
+ * @param max_distance: The view distance. Walls further than this are culled, along with
+ *                      everything behind them.
+ * @param fog: Whether distant walls, floors and ceilings fade to black.
+ * @param fog_start: The distance at which the fog starts. The fog is opaque at `max_distance`.
+ * @param texture_budget: The number of bytes of texels kept resident by the texture cache of a
+ *                        renderer context, or 0 to load every texture up front and keep it.
+ * @param mipmaps: Whether walls are sampled from the mip level closest to one texel per pixel.
+ * @param incremental: Whether a view rendered again from the same camera into the same
+ *                     framebuffer keeps the columns of its last frame that no change to the world
+ *                     has affected. The framebuffer must be left as it was drawn between frames.
+ * @param fixed_point: Whether the viewing rays, wall intersections, projections and texture
+ *                     coordinates of walls, floors and ceilings are found in 16.16 fixed point.
+ *                     The rays are set up from the floating point cosine and sine of the camera
+ *                     angle, and lighting, fog, shading and sprites are still found in floating
+ *                     point, so frames are not bit-identical across machines.
+ */
+struct render_options {
+    enum output_mode output;
+    enum lighting_mode lighting;
+    int max_portal_depth;
+    double max_distance;
+    bool fog;
+    double fog_start;
+    size_t texture_budget;
+    bool mipmaps;
+    bool incremental;
+    bool fixed_point;
+};
+
+/**
+ * Fill in the default render options: dithered output, Lambertian lighting, no view distance
+ * limit, no fog, no texture budget, mipmapped walls, incremental frames and floating point.
+ * 
+ * @param options: The render options.
+ */
+void default_render_options(struct render_options *options);
+
+/**
+ * The texture sizes that have a specialised wall span variant. Textures of any other size
+ * use the generic variant.
+ */
+enum tex_size {
+    TEX_SIZE_64,
+    TEX_SIZE_128,
+    TEX_SIZE_256,
+    TEX_SIZE_ANY,
+    N_TEX_SIZES
+};
+
+struct wall_span;
+struct sprite_span;
+struct plane_span;
+
+/**
+ * A function drawing a single textured column of a wall.
+ */
+typedef void (*wall_span_fn)(struct framebuffer *fb, const struct wall_span *span);
+
+/**
+ * A function drawing a single row of a textured floor or ceiling.
+ */
+typedef void (*plane_span_fn)(struct framebuffer *fb, const struct plane_span *span);
+
+/**
+ * A function drawing a single column of a sprite, skipping its transparent texels.
+ */
+typedef void (*sprite_span_fn)(struct framebuffer *fb, const struct sprite_span *span);
+
+/**
+ * A function drawing a vertical line from (x, y0) to (x, y1) in a flat colour. RGB variants draw
+ * `colour` and the indexed variant draws the palette index `index`.
+ */
+typedef void (*fill_span_fn)(
+    struct framebuffer *fb,
+    const int x,
+    const int y0,
+    const int y1,
+    const struct rgb *colour,
+    const unsigned char index
+);
+
+/**
+ * The inner loop variants used to draw a frame. Each variant is specialised ahead of time,
+ * so the render options are resolved once per frame instead of being branched on per pixel.
+ * 
+ * @param wall_spans: The wall span variants, indexed by texture size.
+ * @param plane_spans: The textured floor and ceiling span variants, indexed by texture size.
+ * @param sprite_span: The sprite span variant.
+ * @param fill_colour: The variant used to fill coloured floors and ceilings.
+ * @param fill_grey: The variant used to fill greyscale floors and ceilings.
+ * @param draw_vertices: Whether the edges of walls are highlighted.
+ * @param options: The render options the pipeline was built from.
+ * @param palette: The palette used by the indexed output style.
+ */
+struct pipeline {
+    wall_span_fn wall_spans[N_TEX_SIZES];
+    plane_span_fn plane_spans[N_TEX_SIZES];
+    sprite_span_fn sprite_span;
+    fill_span_fn fill_colour;
+    fill_span_fn fill_grey;
+    bool draw_vertices;
+    const struct render_options *options;
+    const struct palette *palette;
+};
+
+/**
+ * Select the inner loop variants for the given render options.
+ * 
+ * @param pipeline: The pipeline to be filled in.
+ * @param options: The render options.
+ * @param palette: The palette, which is required by the indexed output style and may otherwise be NULL.
+ */
+void build_pipeline(struct pipeline *pipeline, const struct render_options *options, const struct palette *palette);
+
 /**
  * A struct representing a ray described parametrically.
  * 
@@ -54,11 +229,12 @@ struct ray {
  * 
  * @param camera: A pointer to the camera.
  * @param x: The x coordinate (in the image plane) of the pixel to cast the ray through
+ * @param width: The number of columns in the image plane.
  * @returns A heap allocated ray struct, with the origin being the camera, and the direction
  *          going through the y-slice. In the parametric representation, when t=1, the resulting
  *          vector lies on the image plane.
  */
-struct ray *viewing_ray(const struct camera *camera, const int x);
+struct ray *viewing_ray(const struct camera *camera, const int x, const int width);
 
 /**
  * Deallocate the memory used by a ray.
@@ -68,28 +244,142 @@ struct ray *viewing_ray(const struct camera *camera, const int x);
 void destroy_ray(struct ray *ray);
 
 /**
- * Render the world scene on the given x coordinate.
+ * A sector seen through a column of the frame.
+ * 
+ * @param sector: The id of the sector.
+ * @param y0: The bottom of the rows through which the sector is seen.
+ * @param y1: The row after the top of the rows through which the sector is seen.
+ * @param floor_y1: The row after the top of the floor, which is seen in the rows from `y0`.
+ * @param ceil_y0: The bottom of the ceiling, which is seen in the rows up to `y1`.
+ */
+struct window {
+    int sector;
+    int y0, y1;
+    int floor_y1, ceil_y0;
+};
+
+/**
+ * What each column of a frame saw, recorded by `render()` so that sprites can be clipped to it.
+ * 
+ * @param width: The number of columns the buffer has room for.
+ * @param max_windows: The number of windows each column has room for. This must be at least the
+ *                     maximum portal depth of the render options.
+ * @param depth: The distance to the nearest wall that nothing is seen past in each column, a 1D
+ *               depth buffer. Columns that hit no wall hold HUGE_VAL.
+ * @param n_windows: The number of sectors seen through each column.
+ * @param windows: The sectors seen through each column, front to back, `max_windows` per column.
+ */
+struct column_buffer {
+    int width;
+    int max_windows;
+    float *depth;
+    int *n_windows;
+    struct window *windows;
+};
+
+/**
+ * An entity projected onto the image plane.
  * 
- * @param pixel_arr: The pixel buffer.
+ * @param texture: The sprite texture.
+ * @param sector: The sector the entity is in.
+ * @param depth: The distance from the camera to the entity, given in the basis of the focal length.
+ * @param x0: The left edge of the sprite on the image plane, which may be off the screen.
+ * @param x1: The right edge of the sprite on the image plane.
+ * @param y0: The bottom edge of the sprite on the image plane.
+ * @param y1: The top edge of the sprite on the image plane.
+ */
+struct sprite {
+    const struct texture *texture;
+    int sector;
+    float depth;
+    float x0, x1, y0, y1;
+};
+
+/**
+ * Render the world scene on the given x coordinate. The sectors are traversed iteratively
+ * front to back from the camera's sector, up to the portal depth and view distance limits of
+ * the render options. Textured floors and ceilings are only recorded in the column buffer, to be
+ * drawn by `draw_planes()`.
+ * 
+ * @param fb: The framebuffer.
+ * @param pipeline: The render pipeline.
  * @param camera: The camera.
- * @param sectors: The array of sectors.
- * @param textures: The array of textures.
- * @param lights: The array of lights.
- * @param n_lights: The number of lights in the map.
+ * @param world: The map data.
  * @param ray: The light ray from the camera through the x coordinate on the image plane.
  * @param x: The x coordinate of the image plane.
- * @param sector_id: The id of the sector to be rendered.
- * @param min_t: The minimum distance of objects to be rendered.
+ * @param columns: Records the depth and the sectors seen through the column.
  */
-void render(float *pixel_arr,
+void render(struct framebuffer *fb,
+    const struct pipeline *pipeline,
     const struct camera *camera,
-    struct sector *const *const sectors,
-    texture *textures,
-    struct light *const *const lights,
-    const int n_lights,
+    const struct world *world,
     const struct ray *ray,
     const int x,
-    const int sector_id,
-    const double min_t,
-    const int sector_dist
-);
\ No newline at end of file
+    struct column_buffer *columns
+);
+
+/**
+ * Render the world scene on the given x coordinate like `render()`, but in 16.16 fixed point. The
+ * viewing ray is set up from the camera, and the divides of the wall intersections and
+ * projections are replaced by lookups in a table of reciprocals.
+ * 
+ * @param fb: The framebuffer.
+ * @param pipeline: The render pipeline.
+ * @param camera: The camera.
+ * @param world: The map data.
+ * @param x: The x coordinate of the image plane.
+ * @param columns: Records the depth and the sectors seen through the column.
+ */
+void render_fixed(struct framebuffer *fb,
+    const struct pipeline *pipeline,
+    const struct camera *camera,
+    const struct world *world,
+    const int x,
+    struct column_buffer *columns
+);
+
+/**
+ * Draw the textured floors and ceilings onto the columns x0 up to x1 of a rendered frame. The
+ * rows of each plane recorded in the column buffer are joined into horizontal spans. The depth is
+ * constant along a row of a plane, so the texture coordinates are stepped linearly across a span
+ * without a divide per pixel.
+ *
+ * @param fb: The framebuffer.
+ * @param pipeline: The render pipeline.
+ * @param camera: The camera.
+ * @param world: The map data.
+ * @param columns: The column buffer recorded when the frame was rendered.
+ * @param x0: The first column drawn.
+ * @param x1: The column after the last column drawn.
+ */
+void draw_planes(
+    struct framebuffer *fb,
+    const struct pipeline *pipeline,
+    const struct camera *camera,
+    const struct world *world,
+    const struct column_buffer *columns,
+    const int x0,
+    const int x1
+);
+
+/**
+ * Draw the sprites onto the columns x0 up to x1 of a rendered frame. Each column of a sprite is
+ * clipped to the rows through which its sector was seen, and is hidden behind the nearest wall.
+ * 
+ * @param fb: The framebuffer.
+ * @param pipeline: The render pipeline.
+ * @param columns: The column buffer recorded when the frame was rendered.
+ * @param sprites: The sprites, sorted back to front.
+ * @param n_sprites: The number of sprites.
+ * @param x0: The first column drawn.
+ * @param x1: The column after the last column drawn.
+ */
+void draw_sprites(
+    struct framebuffer *fb,
+    const struct pipeline *pipeline,
+    const struct column_buffer *columns,
+    const struct sprite *sprites,
+    const int n_sprites,
+    const int x0,
+    const int x1
+);
@@ -2,6 +2,62 @@
 #define GAME
 #include "game.h"
 #endif
+#ifndef POOL
+#define POOL
+#include "pool.h"
+#endif
+
+#define MAX_PATH_LEN 256  // the maximum length of a path in the asset manifest
+#define MAX_LINE_LEN 256  // the maximum length of a line of a map
+
+/**
+ * The kinds of asset listed in an asset manifest.
+ * 
+ * ASSET_MAP: The map of sectors.
+ * ASSET_LIGHTS: The lights in the map.
+ * ASSET_ENTITIES: The entities in the map.
+ * ASSET_TEXTURE: A texture. Textures are given ids in the order they are listed.
+ */
+enum asset_type {
+    ASSET_MAP,
+    ASSET_LIGHTS,
+    ASSET_ENTITIES,
+    ASSET_TEXTURE
+};
+
+/**
+ * An asset listed in an asset manifest.
+ * 
+ * @param type: The kind of asset.
+ * @param path: The filepath to read the asset from.
+ * @param id: The texture id of a texture asset.
+ * @param data: The loaded asset, or NULL if it has not been loaded or failed to load.
+ * @param count: The number of sectors, lights or entities loaded by a map, lights or entities asset.
+ * @param load_time: The time taken to load the asset, in seconds.
+ */
+struct asset {
+    enum asset_type type;
+    char path[MAX_PATH_LEN];
+    int id;
+    void *data;
+    int count;
+    double load_time;
+};
+
+/**
+ * A list of the assets making up a level.
+ * 
+ * @param n_assets: The number of assets.
+ * @param assets: The assets.
+ * @param n_textures: The number of texture assets.
+ * @param load_time: The time taken by `load_assets()` to load every asset, in seconds.
+ */
+struct manifest {
+    int n_assets;
+    struct asset *assets;
+    int n_textures;
+    double load_time;
+};
 
 /**
  * Load the map of sectors from the given filepath.
@@ -13,7 +69,7 @@
 struct sector **load_sectors(const char *filepath, int *n_sectors);
 
 /**
- * Load the texture from the given filepath.
+ * Load the texture from the given filepath, and build its mip chain.
  * 
  * @param filepath: The filepath to read the texture data from.
  * @return A pointer to a heap allocated texture array.
@@ -30,6 +86,54 @@ texture load_texture(const char *filepath);
  */
 struct light **load_lights(const char *filepath, int *n_lights);
 
+/**
+ * Load the entities in the map from the given filepath. Each entity is given by its position,
+ * sprite width and height, and sprite texture id. Entities are placed in their sectors when the
+ * world is built.
+ * 
+ * @param filepath: The filepath to read the entity data from.
+ * @param n_entities: The number of entities loaded.
+ * @return A pointer to a heap allocated entity array.
+ */
+struct entity *load_entities(const char *filepath, int *n_entities);
+
+/**
+ * Load the asset manifest from the given filepath. Each line holds the kind of an asset, one of
+ * `map`, `lights`, `entities` or `texture`, followed by its filepath. Blank lines and lines
+ * starting with `#` are ignored. A manifest lists exactly one map and one lights file, and at
+ * most one entities file.
+ * 
+ * @param filepath: The filepath to read the manifest from.
+ * @return A pointer to a heap allocated manifest, or NULL if the manifest is invalid.
+ */
+struct manifest *load_manifest(const char *filepath);
+
+/**
+ * Load a single asset, filling in its data, count and load time.
+ * 
+ * @param asset: The asset.
+ */
+void load_asset(struct asset *asset);
+
+/**
+ * Load every asset in the manifest in parallel on the thread pool, recording the time taken to
+ * load each one and all of them in the manifest.
+ * 
+ * @param manifest: The asset manifest.
+ * @param pool: The thread pool, or NULL to load the assets on the calling thread.
+ * @param world: Filled in with the loaded sectors, textures, lights and entities. Its derived
+ *               data is not built.
+ * @return Whether every asset was loaded. If not, the assets that were loaded are deallocated.
+ */
+bool load_assets(struct manifest *manifest, struct pool *pool, struct world *world);
+
+/**
+ * Deallocate the asset manifest. The loaded assets are not deallocated.
+ * 
+ * @param manifest: The asset manifest.
+ */
+void destroy_manifest(struct manifest *manifest);
+
 /**
  * Deallocate the sector array.
  * 
@@ -38,6 +142,13 @@ struct light **load_lights(const char *filepath, int *n_lights);
  */
 void destroy_sectors(struct sector **sectors, const int n_sectors);
 
+/**
+ * Deallocate the texels, palette indices and mip levels of a texture, keeping the texture itself.
+ * 
+ * @param texture: The texture.
+ */
+void destroy_texels(struct texture *texture);
+
 /**
  * Deallocate the texture array.
  * 
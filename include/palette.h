@@ -0,0 +1,77 @@
+#ifndef GAME
+#define GAME
+#include "game.h"
+#endif
+
+#define PALETTE_SIZE 256  // the number of colours in the palette
+#define N_SHADES 32  // the number of light levels in the shade tables
+#define MAX_RESERVED 64  // the maximum number of flat colours given their own palette entry
+#define HIST_BITS 5  // the number of bits per channel used when quantising textures
+#define HIST_SIZE (1 << (3 * HIST_BITS))  // the number of bins in the colour histogram
+
+/**
+ * An indexed colour palette in the style of BUILD.
+ *
+ * @param n_colours: The number of colours in the palette.
+ * @param colours: The colours of the palette.
+ * @param shades: The shade tables. `shades[level][i]` is the palette index closest to colour `i`
+ *                lit at intensity `level / (N_SHADES - 1)`, so shading a texel is one lookup.
+ * @param inverse: The palette index closest to each colour of the colour histogram.
+ */
+struct palette {
+    int n_colours;
+    struct rgb colours[PALETTE_SIZE];
+    unsigned char shades[N_SHADES][PALETTE_SIZE];
+    unsigned char inverse[HIST_SIZE];
+};
+
+/**
+ * Build a palette for the given textures and sectors using the median cut algorithm. Black is
+ * always index 0, and the first MAX_RESERVED - 1 distinct floor and ceiling colours of the sectors
+ * are given their own entries so that those flats are exact. The flats of any further colours are
+ * drawn in the nearest palette colour, and a warning is printed when that happens.
+ *
+ * @param textures: The array of textures.
+ * @param n_textures: The number of textures.
+ * @param sectors: The array of sectors.
+ * @param n_sectors: The number of sectors.
+ * @return A pointer to a heap allocated palette.
+ */
+struct palette *build_palette(texture *textures, const int n_textures, struct sector **sectors, const int n_sectors);
+
+/**
+ * Quantise the textures and sector colours to the palette, filling in the indices of each texture
+ * and its mip levels, and the floor and ceiling indices of each sector.
+ *
+ * @param palette: The palette.
+ * @param textures: The array of textures.
+ * @param n_textures: The number of textures.
+ * @param sectors: The array of sectors.
+ * @param n_sectors: The number of sectors.
+ */
+void apply_palette(const struct palette *palette, texture *textures, const int n_textures, struct sector **sectors, const int n_sectors);
+
+/**
+ * Return the palette index closest to the given colour.
+ *
+ * @param palette: The palette.
+ * @param colour: The colour.
+ */
+unsigned char nearest_colour(const struct palette *palette, const struct rgb *colour);
+
+/**
+ * Return the shade table level for the given light intensity.
+ *
+ * @param intensity: The light intensity, between 0.0 and 1.0.
+ */
+int shade_level(const float intensity);
+
+/**
+ * Expand an indexed frame to RGB.
+ *
+ * @param palette: The palette.
+ * @param indices: The indexed pixels.
+ * @param pixels: The RGB pixel buffer to be written to.
+ * @param n_pixels: The number of pixels.
+ */
+void expand_indices(const struct palette *palette, const unsigned char *indices, float *pixels, const int n_pixels);
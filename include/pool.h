@@ -0,0 +1,71 @@
+#ifndef GAME
+#define GAME
+#include "game.h"
+#endif
+#include <pthread.h>
+
+/**
+ * A job run by the thread pool.
+ *
+ * @param arg: The argument shared by every job of the batch.
+ * @param job: The index of the job in the batch.
+ */
+typedef void (*job_fn)(void *arg, const int job);
+
+/**
+ * A fixed set of worker threads that run batches of jobs.
+ *
+ * @param n_threads: The number of worker threads. The thread submitting a batch also runs jobs.
+ * @param threads: The worker threads.
+ * @param lock: The lock protecting the batch state.
+ * @param work_ready: Signalled when a new batch is submitted or the pool is stopping.
+ * @param work_done: Signalled when a worker has finished its part of the batch.
+ * @param fn: The job function of the current batch.
+ * @param arg: The argument of the current batch.
+ * @param n_jobs: The number of jobs in the current batch.
+ * @param next_job: The index of the next job to be claimed.
+ * @param n_finished: The number of workers that have finished the current batch.
+ * @param generation: The number of batches submitted so far.
+ * @param stopping: Whether the workers should exit.
+ */
+struct pool {
+    int n_threads;
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    job_fn fn;
+    void *arg;
+    int n_jobs;
+    int next_job;
+    int n_finished;
+    unsigned long generation;
+    bool stopping;
+};
+
+/**
+ * Create a thread pool.
+ *
+ * @param n_threads: The total number of threads running jobs, including the submitting thread.
+ *                   If this is not positive, one thread per core is used.
+ * @return A pointer to a heap allocated thread pool.
+ */
+struct pool *create_pool(int n_threads);
+
+/**
+ * Run a batch of jobs on the thread pool and wait for all of them to finish. This must not be
+ * called from inside a job.
+ *
+ * @param pool: The thread pool, or NULL to run the jobs on the calling thread.
+ * @param fn: The job function.
+ * @param arg: The argument passed to every job.
+ * @param n_jobs: The number of jobs.
+ */
+void run_pool(struct pool *pool, job_fn fn, void *arg, const int n_jobs);
+
+/**
+ * Stop the worker threads and deallocate the thread pool.
+ *
+ * @param pool: The thread pool.
+ */
+void destroy_pool(struct pool *pool);
@@ -0,0 +1,70 @@
+#ifndef GAME
+#define GAME
+#include "game.h"
+#endif
+#include <pthread.h>
+#include <sys/types.h>
+
+#define RELOAD_POLL_MS 250  // how often the files are checked when they cannot be watched
+#define RELOAD_SETTLE_MS 50  // how long a changed file is left alone before it is parsed
+
+struct manifest;
+struct asset;
+struct engine;
+
+/**
+ * Watches the files of a level and parses the ones that change on a background thread. On Linux
+ * the directories of the files are watched with inotify, and elsewhere the modification times of
+ * the files are polled.
+ *
+ * @param manifest: The asset manifest of the level.
+ * @param thread: The background thread.
+ * @param lock: The lock protecting `stopping` and `pending`.
+ * @param stopping: Whether the background thread should exit.
+ * @param fd: The inotify instance, or -1 if the files are polled.
+ * @param watches: The inotify watch of the directory of each asset.
+ * @param names: The filename of each asset within its directory.
+ * @param mtimes: The modification time of each file when it was last parsed.
+ * @param sizes: The size of each file when it was last parsed.
+ * @param changed: Whether each file has changed since it was last parsed.
+ * @param pending: The newly parsed version of each asset, waiting to be swapped in. An asset whose
+ *                 data is NULL has no new version.
+ */
+struct reloader {
+    struct manifest *manifest;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    bool stopping;
+    int fd;
+    int *watches;
+    const char **names;
+    time_t *mtimes;
+    off_t *sizes;
+    bool *changed;
+    struct asset *pending;
+};
+
+/**
+ * Start watching the files listed in an asset manifest for changes.
+ *
+ * @param manifest_path: The filepath of the asset manifest the level was loaded from.
+ * @return A pointer to a heap allocated reloader, or NULL if the manifest is invalid.
+ */
+struct reloader *watch_assets(const char *manifest_path);
+
+/**
+ * Swap the newly parsed assets into the level. Only the data derived from what changed is
+ * rebuilt. The level must not be rendered while this runs, so it is called between frames.
+ *
+ * @param reloader: The reloader.
+ * @param engine: The renderer context the level was loaded into.
+ * @return Whether any asset was swapped in. If so, cameras should be placed in the level again.
+ */
+bool apply_reloads(struct reloader *reloader, struct engine *engine);
+
+/**
+ * Stop watching the files and deallocate the reloader, along with any assets not swapped in.
+ *
+ * @param reloader: The reloader.
+ */
+void stop_watching(struct reloader *reloader);
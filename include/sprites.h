@@ -0,0 +1,71 @@
+#ifndef GAME
+#define GAME
+#include "game.h"
+#endif
+#ifndef GRAPHICS
+#define GRAPHICS
+#include "graphics.h"
+#endif
+
+/**
+ * The sectors and entities seen in a frame. The buffers are kept from frame to frame, so finding
+ * the sprites of a frame only touches the sectors that were seen.
+ *
+ * @param n_sectors: The number of sectors the per-sector arrays have room for.
+ * @param frame: The number of frames whose sprites have been found.
+ * @param seen: The frame in which each sector was last seen.
+ * @param x0: The leftmost column through which each sector was seen in that frame.
+ * @param x1: The column after the rightmost column through which each sector was seen.
+ * @param n_visible: The number of sectors seen in the frame.
+ * @param visible: The ids of the sectors seen in the frame.
+ * @param n_sprites: The number of sprites of the entities in the visible sectors.
+ * @param max_sprites: The number of sprites `sprites` has room for.
+ * @param sprites: The sprites of the entities in the visible sectors, sorted back to front.
+ */
+struct sprite_set {
+    int n_sectors;
+    unsigned long frame;
+    unsigned long *seen;
+    int *x0, *x1;
+    int n_visible;
+    int *visible;
+    int n_sprites;
+    int max_sprites;
+    struct sprite *sprites;
+};
+
+/**
+ * Create an empty sprite set.
+ *
+ * @param n_sectors: The number of sectors in the map.
+ * @return A pointer to a heap allocated sprite set.
+ */
+struct sprite_set *create_sprite_set(const int n_sectors);
+
+/**
+ * Find the sprites of the entities that may be seen in a rendered frame. Only the entity lists of
+ * the sectors seen through some column are visited, and entities outside the columns through
+ * which their sector was seen are culled.
+ *
+ * @param set: The sprite set, which is overwritten.
+ * @param camera: The camera the frame was rendered from.
+ * @param world: The map data.
+ * @param options: The render options.
+ * @param fb: The framebuffer.
+ * @param columns: The column buffer recorded when the frame was rendered.
+ */
+void find_sprites(
+    struct sprite_set *set,
+    const struct camera *camera,
+    const struct world *world,
+    const struct render_options *options,
+    const struct framebuffer *fb,
+    const struct column_buffer *columns
+);
+
+/**
+ * Deallocate the sprite set.
+ *
+ * @param set: The sprite set.
+ */
+void destroy_sprite_set(struct sprite_set *set);
@@ -0,0 +1,239 @@
+#ifndef GAME
+#define GAME
+#include "game.h"
+#endif
+
+/**
+ * Part of the floor plan that must be redrawn by the next frame, wherever it is seen from: the
+ * points within a radius of a segment. A wall is damaged as its own segment, and an entity as a
+ * circle around its position.
+ *
+ * @param a: One end of the segment.
+ * @param b: The other end of the segment.
+ * @param radius: The distance from the segment that is damaged.
+ */
+struct area {
+    struct vec2 a, b;
+    float radius;
+};
+
+/**
+ * The changes made to a world since its derived data was last updated, and the sectors and areas
+ * they have damaged since the last frame. Each sector, wall and light is queued at most once, however
+ * many times it changes.
+ *
+ * @param n_sectors: The number of sectors whose heights have changed.
+ * @param sectors: The ids of the sectors whose heights have changed.
+ * @param n_walls: The number of walls whose endpoints have moved. Moving a wall can hide or reveal
+ *                parts of the map from the lights traced into its sector, so they are traced again.
+ * @param walls: The walls whose endpoints have moved.
+ * @param n_lights: The number of lights that have moved or changed intensity.
+ * @param lights: The ids of the lights that have moved or changed intensity.
+ * @param damaged_all: Whether the whole world must be redrawn by the next frame, after a change
+ *                     that is not traced to sectors, such as reloaded lights or entities.
+ * @param n_damaged: The number of sectors that must be redrawn by the next frame.
+ * @param damaged: The ids of the sectors that must be redrawn by the next frame, after a change
+ *                 to their heights or shape that is seen wherever they are seen.
+ * @param n_areas: The number of areas that must be redrawn by the next frame.
+ * @param max_areas: The number of areas there is room for.
+ * @param areas: The areas that must be redrawn by the next frame: the walls a changed light shines
+ *               on, the portals into sectors with new heights, and the old and new places of
+ *               entities. Only the columns that see them are redrawn.
+ */
+struct changes {
+    int n_sectors;
+    int *sectors;
+    int n_walls;
+    struct wall **walls;
+    int n_lights;
+    int *lights;
+    bool damaged_all;
+    int n_damaged;
+    int *damaged;
+    int n_areas;
+    int max_areas;
+    struct area *areas;
+};
+
+/**
+ * Build the data derived from the map of a newly loaded world: the wall normals and lengths, the
+ * portals leading into each sector, the vertices shared by walls, the entity lists of the sectors,
+ * and the part of each wall that each light reaches, traced through the portals.
+ *
+ * @param world: The world.
+ */
+void build_world(struct world *world);
+
+/**
+ * Return the id of the vertex at the given position. This is a linear search, so the ids of the
+ * vertices that are animated should be looked up once and kept.
+ *
+ * @param world: The world.
+ * @param pos: The position of the vertex.
+ * @return The id of the vertex, or -1 if no wall starts or ends at the position.
+ */
+int find_vertex(const struct world *world, const struct vec2 *pos);
+
+/**
+ * Return the id of the sector containing the given position. This is a linear search over the
+ * sectors.
+ *
+ * @param world: The world.
+ * @param pos: The position.
+ * @return The id of the sector, or 0 if the position is outside the map.
+ */
+int find_sector(const struct world *world, const struct vec2 *pos);
+
+/**
+ * Move a vertex, along with every wall that starts or ends at it.
+ *
+ * @param world: The world.
+ * @param vertex: The id of the vertex.
+ * @param pos: The new position of the vertex.
+ */
+void move_vertex(struct world *world, const int vertex, const struct vec2 *pos);
+
+/**
+ * Change the floor and ceiling heights of a sector. Cameras in the sector keep their height.
+ *
+ * @param world: The world.
+ * @param sector: The id of the sector.
+ * @param floor_z: The new height of the floor.
+ * @param ceil_z: The new height of the ceiling.
+ */
+void set_sector_heights(struct world *world, const int sector, const float floor_z, const float ceil_z);
+
+/**
+ * Move a light.
+ *
+ * @param world: The world.
+ * @param light: The id of the light.
+ * @param pos: The new position of the light.
+ */
+void move_light(struct world *world, const int light, const struct vec2 *pos);
+
+/**
+ * Change the intensity of a light, so that the walls it lights are redrawn.
+ *
+ * @param world: The world.
+ * @param light: The id of the light.
+ * @param intensity: The new intensity of the light.
+ */
+void set_light_intensity(struct world *world, const int light, const float intensity);
+
+/**
+ * Add an entity to the world, in the sector containing its position.
+ *
+ * @param world: The world.
+ * @param entity: The entity, which is copied.
+ * @return The id of the entity.
+ */
+int add_entity(struct world *world, const struct entity *entity);
+
+/**
+ * Move an entity. Entities are kept in the entity lists of their sectors, so moving one into
+ * another sector is constant time. An entity moved into sector 0 is no longer drawn.
+ *
+ * @param world: The world.
+ * @param entity: The id of the entity.
+ * @param pos: The new position of the entity.
+ * @param sector: The sector containing the new position.
+ */
+void move_entity(struct world *world, const int entity, const struct vec2 *pos, const int sector);
+
+/**
+ * Queue a sector to be redrawn by the next frame. The functions changing the world damage what
+ * they affect themselves, so this is only needed after changing the data of a sector directly,
+ * such as its colours or textures.
+ *
+ * @param world: The world.
+ * @param sector: The id of the sector.
+ */
+void damage_sector(struct world *world, const int sector);
+
+/**
+ * Queue the sectors with walls, a floor or a ceiling drawn with a texture, and the entities drawn
+ * with it, to be redrawn by the next frame, after its texels change.
+ *
+ * @param world: The world.
+ * @param texture_id: The id of the texture.
+ */
+void damage_texture(struct world *world, const int texture_id);
+
+/**
+ * Queue an area of the floor plan to be redrawn by the next frame. This is only needed after
+ * changing something drawn there directly.
+ *
+ * @param world: The world.
+ * @param a: One end of the segment.
+ * @param b: The other end of the segment.
+ * @param radius: The distance from the segment that is damaged.
+ */
+void damage_area(struct world *world, const struct vec2 *a, const struct vec2 *b, const float radius);
+
+/**
+ * Queue the whole world to be redrawn by the next frame, after a change that is not traced to
+ * sectors, such as new entities.
+ *
+ * @param world: The world.
+ */
+void damage_world(struct world *world);
+
+/**
+ * Forget the damage once every view of the world has been redrawn.
+ *
+ * @param world: The world.
+ */
+void clear_damage(struct world *world);
+
+/**
+ * Replace the map with a newly loaded version of it. If only vertices, heights, colours and
+ * textures were edited, the edits are applied as changes to the world, so that only the derived
+ * data they affect is rebuilt and only the sectors they change are redrawn. Otherwise all of the
+ * derived data is rebuilt and the whole world is redrawn.
+ *
+ * @param world: The world.
+ * @param sectors: The newly loaded sector array, which the world takes ownership of.
+ * @param n_sectors: The number of sectors loaded.
+ */
+void reload_sectors(struct world *world, struct sector **sectors, const int n_sectors);
+
+/**
+ * Replace the lights with newly loaded ones. If the number of lights is unchanged, the lights
+ * that moved are moved. Otherwise every light is traced again.
+ *
+ * @param world: The world.
+ * @param lights: The newly loaded light array, which the world takes ownership of.
+ * @param n_lights: The number of lights loaded.
+ */
+void reload_lights(struct world *world, struct light **lights, const int n_lights);
+
+/**
+ * Replace the entities with newly loaded ones, placing each in the sector containing it.
+ *
+ * @param world: The world.
+ * @param entities: The newly loaded entity array, which the world takes ownership of.
+ * @param n_entities: The number of entities loaded.
+ */
+void reload_entities(struct world *world, struct entity *entities, const int n_entities);
+
+/**
+ * Rebuild the derived data affected by the changes made since the last update. Only the walls
+ * that moved, the lit spans of the changed lights, and the portals in and out of sectors with new
+ * heights are rebuilt. A changed light is traced again through the portals from its sector, which
+ * damages the parts of walls it reaches before and after. A moved wall can hide or reveal parts
+ * of the map from the lights traced into its sector, so those lights and the lights outside the
+ * map are traced again.
+ * The world must not be changed or updated while it is being rendered, so this is called between
+ * frames.
+ *
+ * @param world: The world.
+ */
+void update_world(struct world *world);
+
+/**
+ * Deallocate the world: its derived data, sectors, textures and lights.
+ *
+ * @param world: The world.
+ */
+void destroy_world(struct world *world);
@@ -0,0 +1,203 @@
+#ifndef POOL
+#define POOL
+#include "pool.h"
+#endif
+#include "agents.h"
+
+/**
+ * A value for each of WALL_LANES walls tested together, in the lanes of a vector. GCC compiles the
+ * arithmetic on vectors to the SIMD instructions of the target, and comparisons give a lane of all
+ * ones where they hold and of zeros where they do not.
+ */
+typedef float vfloat __attribute__ ((vector_size(WALL_LANES * sizeof(float))));
+typedef int32_t vint __attribute__ ((vector_size(WALL_LANES * sizeof(int32_t))));
+
+/**
+ * Return the lanes of `a` where the mask is set, and the lanes of `b` where it is not.
+ */
+static inline vfloat select_float(const vint mask, const vfloat a, const vfloat b) {
+    return (vfloat) ((mask & (vint) a) | (~mask & (vint) b));
+}
+
+/**
+ * Load WALL_LANES floats from an array, which need not be aligned.
+ */
+static inline vfloat load_lanes(const float *a) {
+    vfloat v;
+    memcpy(&v, a, sizeof(v));
+    return v;
+}
+
+/**
+ * Return whether a position is inside a sector, that is in front of every wall of it.
+ */
+static bool inside_sector(const struct sector *sector, const float x, const float y) {
+    const int n = sector->n_outline;
+    const float *outline = sector->outline;
+    const vint none = {0};
+    vint inside = none - 1;
+    for (int j = 0; j < n; j += WALL_LANES) {
+        vfloat start_x = load_lanes(&outline[j]), start_y = load_lanes(&outline[n + j]);
+        vfloat dir_x = load_lanes(&outline[2 * n + j]), dir_y = load_lanes(&outline[3 * n + j]);
+        inside &= (x - start_x) * dir_y - (y - start_y) * dir_x > (float) -FUDGE;
+    }
+    for (int i = 0; i < WALL_LANES; i++) {
+        if (inside[i] == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Find the nearest wall of a sector that a path crosses, testing WALL_LANES walls of the outline
+ * at once. As in `collision()`, s is the fraction of the path and u the fraction of the wall where
+ * they cross, but both are kept as fractions over a positive denominator and compared without
+ * dividing, which leaves one divide for the wall that is crossed instead of two for every wall.
+ * Unlike `collision()`, a wall is only crossed by a path heading out through it, but from the
+ * very start of the path, and from up to WALL_MARGIN behind its line, so that an agent standing on
+ * the line of a wall, or left just past it by rounding, cannot step through it.
+ * Returns the index of the wall, or -1 if the path crosses none.
+ *
+ * @param sector: The sector.
+ * @param x: The x coordinate of the start of the path.
+ * @param y: The y coordinate of the start of the path.
+ * @param path_x: The x component of the path.
+ * @param path_y: The y component of the path.
+ * @param u: Set to the fraction of the wall where the path crosses it.
+ */
+static int cross_outline(const struct sector *sector, const float x, const float y, const float path_x, const float path_y, float *u) {
+    const int n = sector->n_outline;
+    const float *outline = sector->outline;
+    const vfloat zero = {0};
+    const vint none = {0};
+    vfloat best_s = zero + 2.0f, best_u = zero, best_denom = zero + 1.0f;
+    vint best = none - 1, index = none;
+    for (int i = 0; i < WALL_LANES; i++) {
+        index[i] = i;
+    }
+
+    for (int j = 0; j < n; j += WALL_LANES, index += WALL_LANES) {
+        vfloat start_x = load_lanes(&outline[j]), start_y = load_lanes(&outline[n + j]);
+        vfloat dir_x = load_lanes(&outline[2 * n + j]), dir_y = load_lanes(&outline[3 * n + j]);
+        // the signs are flipped from `collision()`, so that the denominator of a path heading
+        // out through a wall is positive
+        vfloat denom = path_y * dir_x - path_x * dir_y;
+        vfloat c_x = start_x - x, c_y = start_y - y;
+        vfloat s = dir_x * c_y - c_x * dir_y;
+        vfloat t = path_x * c_y - c_x * path_y;
+        // s is the distance of the start in front of the line of the wall times its length, and a
+        // start left just behind the line by rounding still crosses it. The ends of the wall are
+        // stretched by as much, so that a path out through a corner crosses one of its walls
+        vfloat length2 = dir_x * dir_x + dir_y * dir_y, margin2 = (float) (WALL_MARGIN * WALL_MARGIN) * length2;
+        vfloat stretch2 = (float) (WALL_MARGIN * WALL_MARGIN) * denom * denom, past = t - denom;
+        vint on_line = (s >= 0.0f) | (s * s <= margin2);
+        vint on_wall = ((t >= 0.0f) | (t * t * length2 <= stretch2)) & ((past <= 0.0f) | (past * past * length2 <= stretch2));
+        vint crosses = (denom >= (float) FUDGE) & on_line & (s <= denom) & on_wall & (s * best_denom < best_s * denom);
+
+        best_s = select_float(crosses, s, best_s);
+        best_u = select_float(crosses, t, best_u);
+        best_denom = select_float(crosses, denom, best_denom);
+        best = (crosses & index) | (~crosses & best);
+    }
+
+    // the nearest wall of the lanes, taking the first of the walls as near as each other
+    int wall = -1, lane = 0;
+    for (int i = 0; i < WALL_LANES; i++) {
+        if (best[i] == -1) {
+            continue;
+        }
+        if (wall == -1) {
+            wall = best[i];
+            lane = i;
+            continue;
+        }
+        float nearer = best_s[i] * best_denom[lane] - best_s[lane] * best_denom[i];
+        if (nearer < 0.0f || (nearer == 0.0f && best[i] < wall)) {
+            wall = best[i];
+            lane = i;
+        }
+    }
+    *u = best_u[lane] / best_denom[lane];
+    return wall;
+}
+
+/**
+ * Move one agent with the rules of `update_location()`. An agent whose path crosses a wall slides
+ * along it and its new path is checked again, and an agent whose path crosses a portal that it can
+ * walk through moves into the next sector.
+ */
+static void move_agent(struct sector *const *sectors, struct agents *agents, const int i, const float dt) {
+    int sector = agents->sector[i];
+    if (sector == 0) {
+        return;
+    }
+    float x = agents->x[i], y = agents->y[i];
+    float new_x = x + dt * agents->vx[i], new_y = y + dt * agents->vy[i];
+
+    for (int slide = 0; slide <= MAX_SLIDES && (new_x != x || new_y != y); slide++) {
+        float path_x = new_x - x, path_y = new_y - y, u;
+        int hit = cross_outline(sectors[sector], x, y, path_x, path_y, &u);
+        if (hit == -1) {
+            x = new_x;
+            y = new_y;
+            break;
+        }
+
+        // an agent squeezing through a portal by its ends stops, and one walking through a portal
+        // it can step into moves into the next sector. Only one portal is crossed per tick, so an
+        // agent cutting a corner of the next sector would step outside it, and it stops too
+        const struct wall *wall = sectors[sector]->walls[hit];
+        if (wall->portal != 0 && (u <= (float) PORTAL_EDGE || u >= (float) (1.0 - PORTAL_EDGE))) {
+            break;
+        } else if (wall->portal != 0 && wall->passable) {
+            if (inside_sector(sectors[wall->portal], new_x, new_y)) {
+                x = new_x;
+                y = new_y;
+                sector = wall->portal;
+            }
+            break;
+        }
+
+        // an agent walking into a wall slides along it by half of its step along the wall, and
+        // stops if it is still walking into walls after MAX_SLIDES slides
+        float walldir_x = wall->end->x - wall->start->x, walldir_y = wall->end->y - wall->start->y;
+        float along = min((path_x * walldir_x + path_y * walldir_y) / wall->length, 0.5f);
+        new_x = x + 0.5f * along * walldir_x;
+        new_y = y + 0.5f * along * walldir_y;
+    }
+
+    agents->x[i] = x;
+    agents->y[i] = y;
+    agents->sector[i] = sector;
+}
+
+/**
+ * The agents moved by the jobs of a tick.
+ *
+ * @param world: The map data.
+ * @param agents: The agents.
+ * @param dt: The length of the tick in seconds.
+ */
+struct move_job {
+    const struct world *world;
+    struct agents *agents;
+    float dt;
+};
+
+/**
+ * Move a block of AGENTS_PER_JOB agents. Run as a thread pool job.
+ */
+static void move_block(void *arg, const int block) {
+    struct move_job *job = arg;
+    int first = block * AGENTS_PER_JOB;
+    int last = min(first + AGENTS_PER_JOB, job->agents->n_agents);
+    for (int i = first; i < last; i++) {
+        move_agent(job->world->sectors, job->agents, i, job->dt);
+    }
+}
+
+void move_agents(const struct world *world, struct pool *pool, struct agents *agents, const float dt) {
+    struct move_job job = {world, agents, dt};
+    run_pool(pool, move_block, &job, (agents->n_agents + AGENTS_PER_JOB - 1) / AGENTS_PER_JOB);
+}
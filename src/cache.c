@@ -0,0 +1,244 @@
+#ifndef LOAD
+#define LOAD
+#include "load.h"
+#endif
+#ifndef WORLD
+#define WORLD
+#include "world.h"
+#endif
+#ifndef CACHE
+#define CACHE
+#include "cache.h"
+#endif
+#include <string.h>
+
+/**
+ * The main loop of the background thread, which loads the requested textures in order.
+ */
+static void *loader(void *data) {
+    struct texture_cache *cache = data;
+
+    pthread_mutex_lock(&cache->lock);
+    while (true) {
+        while (cache->n_requests == 0 && !cache->stopping) {
+            pthread_cond_wait(&cache->work, &cache->lock);
+        }
+        if (cache->stopping) {
+            break;
+        }
+        int id = cache->requests[cache->head];
+        cache->head = (cache->head + 1) % cache->n_textures;
+        cache->n_requests--;
+        pthread_mutex_unlock(&cache->lock);
+
+        texture loaded = load_texture(cache->paths[id]);
+        if (loaded != NULL && cache->palette != NULL) {
+            apply_palette(cache->palette, &loaded, 1, NULL, 0);
+        }
+
+        pthread_mutex_lock(&cache->lock);
+        cache->loaded_ids[cache->n_loaded] = id;
+        cache->loaded[cache->n_loaded++] = loaded;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return NULL;
+}
+
+struct texture_cache *create_texture_cache(struct manifest *manifest, const size_t budget) {
+    struct texture_cache *cache = malloc(sizeof(struct texture_cache));
+    int n = manifest->n_textures;
+    cache->n_textures = n;
+    cache->paths = malloc(max(n, 1) * sizeof(char *));
+    cache->budget = budget;
+    cache->resident = 0;
+    cache->frame = 1;
+    cache->state = calloc(max(n, 1), sizeof(enum residency));
+    cache->sizes = calloc(max(n, 1), sizeof(size_t));
+    cache->last_used = calloc(max(n, 1), sizeof(unsigned long));
+    cache->palette = NULL;
+    pthread_mutex_init(&cache->lock, NULL);
+    pthread_cond_init(&cache->work, NULL);
+    cache->stopping = false;
+    cache->head = 0;
+    cache->n_requests = 0;
+    cache->requests = malloc(max(n, 1) * sizeof(int));
+    cache->n_loaded = 0;
+    cache->loaded_ids = malloc(max(n, 1) * sizeof(int));
+    cache->loaded = malloc(max(n, 1) * sizeof(texture));
+
+    // take the textures out of the manifest, so that only the rest of the level is loaded up front
+    int n_kept = 0;
+    for (int i = 0; i < manifest->n_assets; i++) {
+        struct asset *asset = &manifest->assets[i];
+        if (asset->type == ASSET_TEXTURE) {
+            cache->paths[asset->id] = strdup(asset->path);
+        } else {
+            manifest->assets[n_kept++] = *asset;
+        }
+    }
+    manifest->n_assets = n_kept;
+
+    pthread_create(&cache->thread, NULL, loader, cache);
+    return cache;
+}
+
+void attach_texture_cache(struct texture_cache *cache, struct world *world) {
+    for (int i = 0; i < cache->n_textures; i++) {
+        texture empty = malloc(sizeof(struct texture));
+        *empty = (struct texture) {
+            0, 0, NULL, NULL, {TEXTURE_FALLBACK, TEXTURE_FALLBACK, TEXTURE_FALLBACK}, 0, 0, NULL
+        };
+        world->textures[i] = empty;
+    }
+}
+
+void install_texture(struct texture_cache *cache, struct world *world, const int id, texture loaded) {
+    texture tex = world->textures[id];
+    if (cache->state[id] == TEXTURE_RESIDENT) {
+        cache->resident -= cache->sizes[id];
+    }
+    destroy_texels(tex);
+    *tex = *loaded;
+    free(loaded);
+
+    cache->sizes[id] = 0;
+    for (int i = -1; i < tex->n_mips; i++) {
+        const struct texture *level = i < 0 ? tex : &tex->mips[i];
+        size_t n_texels = (size_t) level->width * level->height;
+        cache->sizes[id] += n_texels * sizeof(struct rgb) + (level->indices != NULL ? n_texels : 0);
+    }
+    cache->resident += cache->sizes[id];
+    cache->state[id] = TEXTURE_RESIDENT;
+    cache->last_used[id] = cache->frame;
+    damage_texture(world, id);
+}
+
+void load_all_textures(struct texture_cache *cache, struct world *world) {
+    for (int i = 0; i < cache->n_textures; i++) {
+        if (cache->state[i] != TEXTURE_EVICTED) {
+            continue;
+        }
+        texture loaded = load_texture(cache->paths[i]);
+        if (loaded == NULL) {
+            fprintf(stderr, "Error loading %s, drawing it in a flat colour\n", cache->paths[i]);
+            cache->state[i] = TEXTURE_MISSING;
+            continue;
+        }
+        install_texture(cache, world, i, loaded);
+    }
+}
+
+/**
+ * Deallocate the texels and mip levels of a resident texture, keeping its fallback colour.
+ */
+static void evict_texture(struct texture_cache *cache, struct world *world, const int id) {
+    destroy_texels(world->textures[id]);
+    damage_texture(world, id);
+    cache->resident -= cache->sizes[id];
+    cache->sizes[id] = 0;
+    cache->state[id] = TEXTURE_EVICTED;
+    #ifdef DEBUG
+    printf("evicted %s, %zu bytes resident\n", cache->paths[id], cache->resident);
+    #endif
+}
+
+void update_textures(struct texture_cache *cache, struct world *world) {
+    pthread_mutex_lock(&cache->lock);
+    for (int i = 0; i < cache->n_loaded; i++) {
+        int id = cache->loaded_ids[i];
+        if (cache->loaded[i] == NULL) {
+            fprintf(stderr, "Error loading %s, drawing it in a flat colour\n", cache->paths[id]);
+            cache->state[id] = TEXTURE_MISSING;
+            continue;
+        }
+        install_texture(cache, world, id, cache->loaded[i]);
+        #ifdef DEBUG
+        printf("loaded %s, %zu bytes resident\n", cache->paths[id], cache->resident);
+        #endif
+    }
+    cache->n_loaded = 0;
+    pthread_mutex_unlock(&cache->lock);
+
+    // the least recently used texture is found by a linear search, as there are few textures. The
+    // textures seen by the last frame are kept even if they alone exceed the budget
+    while (cache->resident > cache->budget) {
+        int lru = -1;
+        for (int i = 0; i < cache->n_textures; i++) {
+            if (cache->state[i] == TEXTURE_RESIDENT && cache->last_used[i] < cache->frame
+            && (lru == -1 || cache->last_used[i] < cache->last_used[lru])) {
+                lru = i;
+            }
+        }
+        if (lru == -1) {
+            break;
+        }
+        evict_texture(cache, world, lru);
+    }
+    cache->frame++;
+}
+
+/**
+ * Mark a texture as used by the current frame, queueing it to be loaded if it is not resident.
+ * Returns whether it was queued. The cache must be locked.
+ */
+static bool touch_texture(struct texture_cache *cache, const int id) {
+    cache->last_used[id] = cache->frame;
+    if (cache->state[id] != TEXTURE_EVICTED) {
+        return false;
+    }
+    cache->state[id] = TEXTURE_LOADING;
+    cache->requests[(cache->head + cache->n_requests++) % cache->n_textures] = id;
+    return true;
+}
+
+void touch_textures(struct texture_cache *cache, const struct world *world, const int *visible, const int n_visible) {
+    bool requested = false;
+    pthread_mutex_lock(&cache->lock);
+    for (int i = 0; i < n_visible; i++) {
+        const struct sector *sector = world->sectors[visible[i]];
+        for (int j = 0; j < sector->n_walls; j++) {
+            requested |= touch_texture(cache, sector->walls[j]->texture_id);
+        }
+        if (sector->floor_texture >= 0) {
+            requested |= touch_texture(cache, sector->floor_texture);
+        }
+        if (sector->ceil_texture >= 0) {
+            requested |= touch_texture(cache, sector->ceil_texture);
+        }
+        for (int j = 0; j < sector->n_entities; j++) {
+            requested |= touch_texture(cache, world->entities[sector->entities[j]].texture_id);
+        }
+    }
+    if (requested) {
+        pthread_cond_signal(&cache->work);
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void destroy_texture_cache(struct texture_cache *cache) {
+    pthread_mutex_lock(&cache->lock);
+    cache->stopping = true;
+    pthread_cond_signal(&cache->work);
+    pthread_mutex_unlock(&cache->lock);
+    pthread_join(cache->thread, NULL);
+
+    for (int i = 0; i < cache->n_loaded; i++) {
+        if (cache->loaded[i] != NULL) {
+            destroy_texels(cache->loaded[i]);
+            free(cache->loaded[i]);
+        }
+    }
+    for (int i = 0; i < cache->n_textures; i++) {
+        free(cache->paths[i]);
+    }
+    pthread_mutex_destroy(&cache->lock);
+    pthread_cond_destroy(&cache->work);
+    free(cache->paths);
+    free(cache->state);
+    free(cache->sizes);
+    free(cache->last_used);
+    free(cache->requests);
+    free(cache->loaded_ids);
+    free(cache->loaded);
+    free(cache);
+}
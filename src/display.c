@@ -0,0 +1,46 @@
+#define GL_SILENCE_DEPRECATION
+#include <GLFW/glfw3.h>
+
+#include "display.h"
+
+void init_resolution(struct resolution *res, struct framebuffer *fb, const int width, const int height, const double target) {
+    res->max_width = width;
+    res->max_height = height;
+    res->scale = 1.0f;
+    res->target = target;
+
+    fb->width = width;
+    fb->height = height;
+}
+
+void scale_resolution(struct resolution *res, struct framebuffer *fb, const double frame_time) {
+    if (res->target <= 0.0 || frame_time <= 0.0) {
+        return;
+    }
+
+    // the ideal scale renders the same frame in exactly the target time
+    float ideal = res->scale * sqrtf(res->target / frame_time);
+    float scale = res->scale + RES_GAIN * (ideal - res->scale);
+    scale = min(max(scale, MIN_RES_SCALE), 1.0f);
+
+    if (fabsf(scale - res->scale) < RES_DEADBAND * res->scale) {
+        // avoid resizing every frame over noise in the frame time
+        return;
+    }
+    res->scale = scale;
+
+    fb->width = max((int) (res->max_width * scale), 1);
+    fb->height = max((int) (res->max_height * scale), 1);
+    #ifdef DEBUG
+    printf("resolution scaled to %dx%d (%.0f%%)\n", fb->width, fb->height, scale * 100.0f);
+    #endif
+}
+
+void present(const struct framebuffer *fb, const struct palette *palette, const int window_width, const int window_height) {
+    if (palette != NULL) {
+        expand_indices(palette, fb->indices, fb->pixels, fb->width * fb->height);
+    }
+    glRasterPos2i(-1, -1);
+    glPixelZoom((float) window_width / fb->width, (float) window_height / fb->height);
+    glDrawPixels(fb->width, fb->height, GL_RGB, GL_FLOAT, fb->pixels);
+}
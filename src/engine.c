@@ -0,0 +1,444 @@
+#include "engine.h"
+
+/**
+ * A set of columns of a frame to be rendered.
+ *
+ * @param fb: The framebuffer.
+ * @param pipeline: The render pipeline.
+ * @param camera: The camera.
+ * @param world: The map data.
+ * @param view: The buffers of the view.
+ * @param n_bands: The number of bands the columns of the frame are split into.
+ */
+struct frame_job {
+    struct framebuffer *fb;
+    const struct pipeline *pipeline;
+    const struct camera *camera;
+    const struct world *world;
+    struct view *view;
+    int n_bands;
+};
+
+/**
+ * A batch of views to be rendered.
+ *
+ * @param pipeline: The render pipeline.
+ * @param cameras: The cameras.
+ * @param fbs: The framebuffers.
+ * @param world: The map data.
+ * @param views: The buffers of the views.
+ * @param n_dirty: The number of columns of each view rendered again.
+ */
+struct batch_job {
+    const struct pipeline *pipeline;
+    const struct camera *cameras;
+    struct framebuffer *fbs;
+    const struct world *world;
+    struct view *views;
+    const int *n_dirty;
+};
+
+/**
+ * Render the columns from x0 up to x1 of a frame, in fixed point if the render options ask for it.
+ */
+static void render_columns(
+    struct framebuffer *fb,
+    const struct pipeline *pipeline,
+    const struct camera *camera,
+    const struct world *world,
+    struct column_buffer *columns,
+    const int x0,
+    const int x1
+) {
+    if (pipeline->options->fixed_point) {
+        for (int x = x0; x < x1; x++) {
+            render_fixed(fb, pipeline, camera, world, x, columns);
+        }
+        return;
+    }
+    for (int x = x0; x < x1; x++) {
+        struct ray *ray = viewing_ray(camera, x, fb->width);
+        render(fb, pipeline, camera, world, ray, x, columns);
+        destroy_ray(ray);
+    }
+}
+
+/**
+ * Return the end of the run of dirty columns of a view starting at x, stopping at x1.
+ */
+static int dirty_run(const struct view *view, const int x, const int x1) {
+    int end = x + 1;
+    while (end < x1 && view->dirty[end]) {
+        end++;
+    }
+    return end;
+}
+
+/**
+ * Render the walls, then the textured floors and ceilings, of the dirty columns from x0 up to x1
+ * of a view.
+ */
+static void render_dirty(
+    struct framebuffer *fb,
+    const struct pipeline *pipeline,
+    const struct camera *camera,
+    const struct world *world,
+    struct view *view,
+    const int x0,
+    const int x1
+) {
+    for (int x = x0; x < x1; x++) {
+        if (view->dirty[x]) {
+            int end = dirty_run(view, x, x1);
+            render_columns(fb, pipeline, camera, world, &view->columns, x, end);
+            draw_planes(fb, pipeline, camera, world, &view->columns, x, end);
+            x = end;
+        }
+    }
+}
+
+/**
+ * Draw the sprites onto the dirty columns from x0 up to x1 of a view.
+ */
+static void draw_dirty_sprites(struct framebuffer *fb, const struct pipeline *pipeline, struct view *view, const int x0, const int x1) {
+    const struct sprite_set *sprites = view->sprites;
+    for (int x = x0; x < x1; x++) {
+        if (view->dirty[x]) {
+            int end = dirty_run(view, x, x1);
+            draw_sprites(fb, pipeline, &view->columns, sprites->sprites, sprites->n_sprites, x, end);
+            x = end;
+        }
+    }
+}
+
+/**
+ * Render one band of columns of a frame. Run as a thread pool job.
+ */
+static void render_band(void *arg, const int band) {
+    struct frame_job *job = arg;
+    int x0 = (long) job->fb->width * band / job->n_bands;
+    int x1 = (long) job->fb->width * (band + 1) / job->n_bands;
+    render_dirty(job->fb, job->pipeline, job->camera, job->world, job->view, x0, x1);
+}
+
+/**
+ * Draw the sprites onto one band of columns of a frame. Run as a thread pool job.
+ */
+static void sprite_band(void *arg, const int band) {
+    struct frame_job *job = arg;
+    int x0 = (long) job->fb->width * band / job->n_bands;
+    int x1 = (long) job->fb->width * (band + 1) / job->n_bands;
+    draw_dirty_sprites(job->fb, job->pipeline, job->view, x0, x1);
+}
+
+/**
+ * Render one view of a batch, walls then textured floors and ceilings then sprites. Run as a
+ * thread pool job.
+ */
+static void render_view(void *arg, const int view) {
+    struct batch_job *job = arg;
+    struct framebuffer *fb = &job->fbs[view];
+    struct view *v = &job->views[view];
+    if (job->n_dirty[view] == 0) {
+        return;
+    }
+    render_dirty(fb, job->pipeline, &job->cameras[view], job->world, v, 0, fb->width);
+    find_sprites(v->sprites, &job->cameras[view], job->world, job->pipeline->options, fb, &v->columns);
+    draw_dirty_sprites(fb, job->pipeline, v, 0, fb->width);
+}
+
+/**
+ * Return whether the render options draw frames the same way.
+ */
+static bool same_options(const struct render_options *a, const struct render_options *b) {
+    return a->output == b->output && a->lighting == b->lighting && a->max_portal_depth == b->max_portal_depth
+        && a->max_distance == b->max_distance && a->fog == b->fog && a->fog_start == b->fog_start
+        && a->mipmaps == b->mipmaps && a->fixed_point == b->fixed_point;
+}
+
+/**
+ * Mark the columns of a view that may see a damaged area. The area is bounded by the box around
+ * each end of its segment, and the columns that saw a wall in front of all of it are left alone.
+ */
+static void mark_area(struct view *view, const struct camera *camera, const int width, const struct area *area) {
+    // the camera looks along -(cos, sin), and the image plane runs along (sin, -cos)
+    const struct vec2 *ends[2] = {&area->a, &area->b};
+    float z[2], l[2];
+    for (int i = 0; i < 2; i++) {
+        float dx = ends[i]->x - camera->pos->x;
+        float dy = ends[i]->y - camera->pos->y;
+        z[i] = -(dx * camera->anglecos + dy * camera->anglesin);
+        l[i] = dx * camera->anglesin - dy * camera->anglecos;
+    }
+    const float r = area->radius, near = r + DAMAGE_NEAR;
+    if (z[0] + r <= 0.0f && z[1] + r <= 0.0f) {
+        return;
+    }
+
+    double lo = HUGE_VAL, hi = -HUGE_VAL;
+    if (z[0] < near && z[1] < near) {
+        lo = -HUGE_VAL;
+        hi = HUGE_VAL;
+    }
+    for (int i = 0; i < 2 && lo != -HUGE_VAL; i++) {
+        int j = 1 - i;
+        if (z[i] < near) {
+            // the part of the segment clipped off projects further and further out, towards the
+            // side it crosses the camera on
+            if (r > 0.0f) {
+                lo = -HUGE_VAL;
+                hi = HUGE_VAL;
+                break;
+            }
+            float crossing = l[i] - z[i] * (l[j] - l[i]) / (z[j] - z[i]);
+            if (crossing >= 0.0f) {
+                lo = -HUGE_VAL;
+            }
+            if (crossing <= 0.0f) {
+                hi = HUGE_VAL;
+            }
+            l[i] += (near - z[i]) * (l[j] - l[i]) / (z[j] - z[i]);
+            z[i] = near;
+        }
+    }
+    for (int i = 0; i < 2; i++) {
+        for (int k = 0; k < 4; k++) {
+            float u = -(l[i] + (k & 1 ? r : -r)) / (z[i] + (k & 2 ? r : -r));
+            lo = fmin(lo, u);
+            hi = fmax(hi, u);
+        }
+    }
+
+    // column x is seen through u = -1 + (2x + 1) / width, and a column of slack covers rounding
+    double x0 = (lo + 1.0) * width / 2.0 - 1.5, x1 = (hi + 1.0) * width / 2.0 + 0.5;
+    int start = x0 < 0.0 ? 0 : (int) x0;
+    int end = x1 >= width ? width : (int) x1 + 1;
+    float depth = fminf(z[0], z[1]) - r - DAMAGE_NEAR;
+    for (int x = start; x < end; x++) {
+        view->dirty[x] |= view->columns.depth[x] >= depth;
+    }
+}
+
+/**
+ * Mark the columns of a view that must be rendered again and return how many there are. If the
+ * view is drawn from the same camera into the same framebuffer as its last frame, only the columns
+ * that saw a damaged sector or may see a damaged area are rendered again. Otherwise every column
+ * is.
+ */
+static int find_dirty_columns(struct engine *engine, struct view *view, const struct camera *camera, const struct framebuffer *fb) {
+    const struct changes *changes = engine->world.changes;
+    bool reuse = engine->options.incremental && view->valid && !changes->damaged_all
+        && camera->pos->x == view->pos.x && camera->pos->y == view->pos.y && camera->angle == view->camera.angle
+        && camera->sector == view->camera.sector && camera->height == view->camera.height
+        && fb->width == view->fb.width && fb->height == view->fb.height
+        && fb->pixels == view->fb.pixels && fb->indices == view->fb.indices
+        && same_options(&engine->options, &view->options);
+
+    view->valid = true;
+    view->camera = *camera;
+    view->pos = *camera->pos;
+    view->fb = *fb;
+    view->options = engine->options;
+    if (!reuse) {
+        memset(view->dirty, true, fb->width * sizeof(bool));
+        return fb->width;
+    }
+    memset(view->dirty, false, fb->width * sizeof(bool));
+    if (changes->n_damaged == 0 && changes->n_areas == 0) {
+        return 0;
+    }
+    for (int i = 0; i < changes->n_areas; i++) {
+        mark_area(view, camera, fb->width, &changes->areas[i]);
+    }
+
+    int n_dirty = 0;
+    for (int x = 0; x < fb->width; x++) {
+        const struct window *windows = &view->columns.windows[x * view->columns.max_windows];
+        for (int i = 0; i < view->columns.n_windows[x] && !view->dirty[x]; i++) {
+            view->dirty[x] = engine->world.sectors[windows[i].sector]->damaged;
+        }
+        n_dirty += view->dirty[x];
+    }
+    return n_dirty;
+}
+
+/**
+ * Make sure there are buffers for the given number of views, each big enough for the given
+ * framebuffers, the current portal depth limit and the current map.
+ */
+static void prepare_views(struct engine *engine, const struct framebuffer *fbs, const int n_views) {
+    if (n_views > engine->n_views) {
+        engine->views = realloc(engine->views, n_views * sizeof(struct view));
+        for (int i = engine->n_views; i < n_views; i++) {
+            engine->views[i].columns = (struct column_buffer) {0, 0, NULL, NULL, NULL};
+            engine->views[i].sprites = create_sprite_set(engine->world.n_sectors);
+            engine->views[i].valid = false;
+            engine->views[i].dirty = NULL;
+        }
+        engine->n_views = n_views;
+    }
+
+    // the map may have been reloaded with a different number of sectors
+    for (int i = 0; i < engine->n_views; i++) {
+        if (engine->views[i].sprites->n_sectors != engine->world.n_sectors) {
+            destroy_sprite_set(engine->views[i].sprites);
+            engine->views[i].sprites = create_sprite_set(engine->world.n_sectors);
+            engine->views[i].valid = false;
+        }
+    }
+
+    for (int i = 0; i < n_views; i++) {
+        struct column_buffer *columns = &engine->views[i].columns;
+        int max_windows = max(engine->options.max_portal_depth, 1);
+        if (fbs[i].width > columns->width || max_windows > columns->max_windows) {
+            columns->width = max(fbs[i].width, columns->width);
+            columns->max_windows = max(max_windows, columns->max_windows);
+            columns->depth = realloc(columns->depth, columns->width * sizeof(float));
+            columns->n_windows = realloc(columns->n_windows, columns->width * sizeof(int));
+            columns->windows = realloc(columns->windows, columns->width * columns->max_windows * sizeof(struct window));
+            engine->views[i].dirty = realloc(engine->views[i].dirty, columns->width * sizeof(bool));
+            engine->views[i].valid = false;
+        }
+    }
+}
+
+struct engine *create_engine(const char *manifest_path, const struct render_options *options, const int n_threads) {
+    struct manifest *manifest = load_manifest(manifest_path);
+    if (manifest == NULL) {
+        return NULL;
+    }
+
+    struct engine *engine = malloc(sizeof(struct engine));
+    engine->pool = create_pool(n_threads);
+    engine->textures = NULL;
+    if (options->texture_budget > 0) {
+        // the textures are left to be loaded on first use
+        engine->textures = create_texture_cache(manifest, options->texture_budget);
+    }
+    struct world *world = &engine->world;
+    bool loaded = load_assets(manifest, engine->pool, world);
+    engine->n_assets = manifest->n_assets;
+    engine->load_time = manifest->load_time;
+    destroy_manifest(manifest);
+    if (!loaded) {
+        if (engine->textures != NULL) {
+            destroy_texture_cache(engine->textures);
+        }
+        destroy_pool(engine->pool);
+        free(engine);
+        return NULL;
+    }
+    if (engine->textures != NULL) {
+        attach_texture_cache(engine->textures, world);
+    }
+    build_world(world);
+
+    // quantise the textures and flats for the indexed output style
+    engine->options = *options;
+    engine->palette = NULL;
+    engine->n_views = 0;
+    engine->views = NULL;
+    if (options->output == OUTPUT_INDEXED) {
+        // every texture is loaded once to build the palette, and evicted again after the first frame
+        if (engine->textures != NULL) {
+            load_all_textures(engine->textures, world);
+        }
+        engine->palette = build_palette(world->textures, world->n_textures, world->sectors, world->n_sectors);
+        apply_palette(engine->palette, world->textures, world->n_textures, world->sectors, world->n_sectors);
+        if (engine->textures != NULL) {
+            engine->textures->palette = engine->palette;
+        }
+    }
+    return engine;
+}
+
+void place_camera(const struct engine *engine, struct camera *camera, struct vec2 *pos, const float angle, const int sector) {
+    camera->pos = pos;
+    camera->angle = angle;
+    camera->anglecos = cos(angle);
+    camera->anglesin = sin(angle);
+    camera->sector = sector;
+    camera->height = CAM_Z + engine->world.sectors[sector]->floor_z;
+}
+
+int render_frame(struct engine *engine, const struct camera *camera, struct framebuffer *fb) {
+    if (engine->textures != NULL) {
+        update_textures(engine->textures, &engine->world);
+    }
+    struct pipeline pipeline;
+    build_pipeline(&pipeline, &engine->options, engine->palette);
+    prepare_views(engine, fb, 1);
+
+    // the damage is forgotten once it is drawn, so the other views cannot be reused
+    struct view *view = &engine->views[0];
+    int n_dirty = find_dirty_columns(engine, view, camera, fb);
+    for (int i = 1; i < engine->n_views; i++) {
+        engine->views[i].valid = false;
+    }
+    clear_damage(&engine->world);
+
+    if (n_dirty > 0) {
+        struct frame_job job = {
+            fb,
+            &pipeline,
+            camera,
+            &engine->world,
+            view,
+            min((engine->pool->n_threads + 1) * BANDS_PER_THREAD, fb->width)
+        };
+        run_pool(engine->pool, render_band, &job, job.n_bands);
+
+        find_sprites(view->sprites, camera, &engine->world, &engine->options, fb, &view->columns);
+        if (view->sprites->n_sprites > 0) {
+            run_pool(engine->pool, sprite_band, &job, job.n_bands);
+        }
+    }
+    if (engine->textures != NULL) {
+        touch_textures(engine->textures, &engine->world, view->sprites->visible, view->sprites->n_visible);
+    }
+    return n_dirty;
+}
+
+void render_batch(struct engine *engine, const struct camera *cameras, struct framebuffer *fbs, const int n_views) {
+    if (engine->textures != NULL) {
+        update_textures(engine->textures, &engine->world);
+    }
+    struct pipeline pipeline;
+    build_pipeline(&pipeline, &engine->options, engine->palette);
+    prepare_views(engine, fbs, n_views);
+
+    int *n_dirty = malloc(n_views * sizeof(int));
+    for (int i = 0; i < engine->n_views; i++) {
+        if (i < n_views) {
+            n_dirty[i] = find_dirty_columns(engine, &engine->views[i], &cameras[i], &fbs[i]);
+        } else {
+            engine->views[i].valid = false;
+        }
+    }
+    clear_damage(&engine->world);
+
+    struct batch_job job = {&pipeline, cameras, fbs, &engine->world, engine->views, n_dirty};
+    run_pool(engine->pool, render_view, &job, n_views);
+    free(n_dirty);
+    for (int i = 0; i < n_views && engine->textures != NULL; i++) {
+        touch_textures(engine->textures, &engine->world, engine->views[i].sprites->visible, engine->views[i].sprites->n_visible);
+    }
+}
+
+void destroy_engine(struct engine *engine) {
+    for (int i = 0; i < engine->n_views; i++) {
+        free(engine->views[i].columns.depth);
+        free(engine->views[i].columns.n_windows);
+        free(engine->views[i].columns.windows);
+        free(engine->views[i].dirty);
+        destroy_sprite_set(engine->views[i].sprites);
+    }
+    free(engine->views);
+    if (engine->textures != NULL) {
+        destroy_texture_cache(engine->textures);
+    }
+    destroy_world(&engine->world);
+    free(engine->palette);
+    destroy_pool(engine->pool);
+    free(engine);
+}
@@ -0,0 +1,37 @@
+#include "game.h"
+
+// 2^62 divided by the middle of each of the 2^RECIP_BITS equal parts of [2^31, 2^32)
+#define RECIP(i) ((uint32_t) ((1ULL << 62) / ((1ULL << 31) + ((2ULL * (i) + 1) << (30 - RECIP_BITS)))))
+#define RECIP4(i) RECIP(i), RECIP((i) + 1), RECIP((i) + 2), RECIP((i) + 3)
+#define RECIP16(i) RECIP4(i), RECIP4((i) + 4), RECIP4((i) + 8), RECIP4((i) + 12)
+#define RECIP64(i) RECIP16(i), RECIP16((i) + 16), RECIP16((i) + 32), RECIP16((i) + 48)
+#define RECIP256(i) RECIP64(i), RECIP64((i) + 64), RECIP64((i) + 128), RECIP64((i) + 192)
+#define RECIP1024(i) RECIP256(i), RECIP256((i) + 256), RECIP256((i) + 512), RECIP256((i) + 768)
+
+// the table is built by the compiler, so it needs no setup and is the same in every build
+static const uint32_t recip_table[1 << RECIP_BITS] = {RECIP1024(0)};
+
+fixed fixed_div(const int64_t num, const int64_t den) {
+    // scale the divisor by 2^-e into m in [2^31, 2^32), whose top bits index the table
+    int e = 63 - __builtin_clzll(den) - 31;
+    uint64_t m = e >= 0 ? (uint64_t) den >> e : (uint64_t) den << -e;
+    uint64_t r = recip_table[(m >> (31 - RECIP_BITS)) - (1 << RECIP_BITS)];
+
+    // one Newton-Raphson step, r += r * (2^62 - m * r) / 2^62, doubles the bits of r that are right
+    int64_t error = (int64_t) ((1ULL << 62) - m * r);
+    r += ((int64_t) r * (error >> 31)) >> 31;
+
+    // num / den = num * r / 2^(62 + e), with num cut to 31 bits so that the product fits. The
+    // quotient is rounded to the nearest, so that exact quotients stay exact despite the error in r
+    uint64_t n = num < 0 ? -(uint64_t) num : (uint64_t) num;
+    int f = max(63 - __builtin_clzll(n | 1) - 30, 0);
+    int shift = 62 - FIXED_BITS + e - f;
+    uint64_t q;
+    if (shift < 1) {
+        q = INT32_MAX;
+    } else {
+        q = shift < 64 ? ((n >> f) * r + (1ULL << (shift - 1))) >> shift : 0;
+        q = min(q, INT32_MAX);
+    }
+    return num < 0 ? -(fixed) q : (fixed) q;
+}
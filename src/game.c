@@ -1,3 +1,6 @@
+#define GL_SILENCE_DEPRECATION
+#include <GLFW/glfw3.h>
+
 #ifndef GAME
 #define GAME
 #include "game.h"
@@ -95,9 +98,7 @@ bool update_location(struct camera *camera,
         if (collision(camera, wall, new, &t)) {
             if (wall->portal != 0 && (t <= 0 + 0.005 || t >= 1 - 0.005)) {
                 return false;
-            } else if (wall->portal != 0 
-            && fabs(sectors[camera->sector]->floor_z  - sectors[wall->portal]->floor_z) < 1.0
-            && sectors[wall->portal]->ceil_z - sectors[wall->portal]->floor_z > CAM_Z + FUDGE) {
+            } else if (wall->portal != 0 && wall->passable) {
                 camera->height += sectors[wall->portal]->floor_z - sectors[camera->sector]->floor_z;
                 camera->sector = wall->portal;
                 return true;
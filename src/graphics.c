@@ -1,4 +1,5 @@
 #include "graphics.h"
+#include <stdint.h>
 
 // the bayer matrix used to perform the ordered dithering
 static const float bayer_matrix[BAYER_NUM][BAYER_NUM] = {
@@ -14,29 +15,34 @@ static const float bayer_matrix[BAYER_NUM][BAYER_NUM] = {
 
 static const struct rgb vertex_colour = {235.0 / 255.0, 229.0 / 255.0, 206.0 / 255.0};
 
+// the two colours of the dithered output
+static const struct rgb light_colour = {235.0 / 255.0, 229.0 / 255.0, 206.0 / 255.0};
+static const struct rgb dark_colour = {46.0 / 255.0, 48.0 / 255.0, 55.0 / 255.0};
+
+// the colour that distant walls fade to and that culled sectors are filled with
+static const struct rgb fog_colour = {0.0, 0.0, 0.0};
+
 float dot(const struct vec2 *a, const struct vec2 *b) {
     return (a->x * b->x) + (a->y * b->y);
 }
 
 float Q_rsqrt(const float number) {
-  int i;
-  float x2, y;
+  union {
+    float f;
+    int i;
+  } conv;
+  float x2;
   const float threehalfs = 1.5F;
 
   x2 = number * 0.5F;
-  y  = number;
-  i  = * ( int * ) &y;                       // evil floating point bit level hacking
-  i  = 0x5f3759df - ( i >> 1 );               // what the fuck?
-  y  = * ( float * ) &i;
-  y  = y * ( threehalfs - ( x2 * y * y ) );   // 1st iteration
-  // y  = y * ( threehalfs - ( x2 * y * y ) );   // 2nd iteration, this can be removed
+  conv.f = number;
+  conv.i = 0x5f3759df - ( conv.i >> 1 );     // evil floating point bit level hacking
+  conv.f = conv.f * ( threehalfs - ( x2 * conv.f * conv.f ) );   // 1st iteration
+  // conv.f = conv.f * ( threehalfs - ( x2 * conv.f * conv.f ) );   // 2nd iteration, this can be removed
 
-  return y;
+  return conv.f;
 }
 
-/**
- * Return a normalised version of the given vector v.
- */
 struct vec2 normalise(const struct vec2 *v) {
     float invsqrt = Q_rsqrt(powf(v->x, 2.0) + powf(v->y, 2.0));
 
@@ -46,23 +52,12 @@ struct vec2 normalise(const struct vec2 *v) {
     };
 }
 
-/**
- * Return the clockwise normal to the given wall.
- */
-struct vec2 wall_norm(const struct wall *wall) {
-    float walldir_x = wall->end->x - wall->start->x;
-    float walldir_y = wall->end->y - wall->start->y;
-
-    struct vec2 walln = {walldir_y, -walldir_x};
-    return normalise(&walln);
-}
-
-struct ray *viewing_ray(const struct camera *camera, const int x) {
-    double u_coord = -1.0 + (2 * (x + 0.5)) / SCR_WIDTH;
+struct ray *viewing_ray(const struct camera *camera, const int x, const int width) {
+    double u_coord = -1.0 + (2 * (x + 0.5)) / width;
     
     struct vec2 *ray_dir = malloc(sizeof(struct vec2));
-    ray_dir->x = FOCAL_LEN * camera->anglecos + (WORLD2CAM(x) * camera->anglesin);
-    ray_dir->y = FOCAL_LEN * camera->anglesin + (WORLD2CAM(x) * -camera->anglecos);
+    ray_dir->x = FOCAL_LEN * camera->anglecos + (WORLD2CAM(x, width) * camera->anglesin);
+    ray_dir->y = FOCAL_LEN * camera->anglesin + (WORLD2CAM(x, width) * -camera->anglecos);
 
     struct ray *ray = malloc(sizeof(struct ray));
     ray->direction = ray_dir;
@@ -128,53 +123,519 @@ static bool intersection(
 }
 
 /**
- * Get the length of the given wall. Uses the Alpha max plus beta min algorithm:
- * https://en.wikipedia.org/wiki/Alpha_max_plus_beta_min_algorithm
+ * Determine if there is an intersection between a given wall and a viewing ray like
+ * `intersection()`, but in fixed point. The products are exact in 64 bits, so the range checks
+ * are made on them before anything is divided.
  * 
- * @param wall: The wall.
- * @returns the magnitude of the wall.
+ * @param origin: The origin of the viewing ray.
+ * @param dir: The direction of the viewing ray.
+ * @param wall: The wall which an intersection is to be checked with.
+ * @param min_t: The minimum depth considered.
+ * @param depth: The depth of the intersection.
+ * @param length: How far along the wall with respect to the start endpoint the intersection occurs at.
+ * @param is_vertex: Whether the hit point is on the endpoints or not.
+ * @return Whether there was an intersection or not.
  */
-static float wall_length(const struct wall *wall) {
-    float wall_len_x = abs(wall->end->x - wall->start->x);
-    float wall_len_y = abs(wall->end->y - wall->start->y);
+static bool intersection_fixed(
+    const struct fixed_vec2 *origin,
+    const struct fixed_vec2 *dir,
+    const struct wall *wall,
+    const fixed min_t,
+    fixed *depth,
+    fixed *length,
+    bool *is_vertex
+) {
+    const struct fixed_vec2 *walldir = &wall->fixed_dir;
+    int64_t p_min_l_x = origin->x - wall->fixed_start.x;
+    int64_t p_min_l_y = origin->y - wall->fixed_start.y;
+
+    // the numerators and denominator have 32 fractional bits, and are flipped so that the
+    // denominator is positive
+    int64_t denom = (int64_t) walldir->x * dir->y - (int64_t) walldir->y * dir->x;
+    int64_t s_num = p_min_l_x * dir->y - p_min_l_y * dir->x;
+    int64_t t_num = walldir->x * p_min_l_y - walldir->y * p_min_l_x;
+    if (denom < 0) {
+        denom = -denom;
+        s_num = -s_num;
+        t_num = -t_num;
+    }
+    if (denom < (int64_t) (FUDGE * FIXED_ONE * FIXED_ONE) || s_num < 0 || s_num > denom) {
+        // the lines are parallel, or the intersection lies outside of the wall
+        return false;
+    }
+    fixed t = fixed_div(t_num, denom);
+    if (t < min_t) {
+        return false;
+    }
 
-    return ALPHA * max(wall_len_x, wall_len_y) + BETA * min(wall_len_x, wall_len_y);
+    fixed s = fixed_div(s_num, denom);
+    *is_vertex = s < (fixed) (EDGE_LIM * FIXED_ONE) || s > FIXED_ONE - (fixed) (EDGE_LIM * FIXED_ONE);
+    *depth = t;
+    *length = s;
+    return true;
 }
 
 /**
- * Draw a vertical line from (x, y0) to (x, y1) in the pixel buffer.
+ * Draw a vertical line from (x, y0) to (x, y1) in a single flat colour.
  * 
- * @param pixel_arr: The pixel buffer.
+ * @param fb: The framebuffer.
  * @param x: The x coordinate of the line.
  * @param y0: The starting endpoint of the line.
  * @param y1: The ending endpoint of the line.
  * @param colour: The colour of the line.
+ * @param index: Unused.
  */
-static void draw_vert(float *pixel_arr, const int x, const int y0, const int y1, const struct rgb *colour) {
+static void fill_colour(
+    struct framebuffer *fb,
+    const int x,
+    const int y0,
+    const int y1,
+    const struct rgb *colour,
+    const unsigned char index
+) {
     for (int i = y0; i < y1; i++) {
-        if (fabs(colour->r - colour->g) > FUDGE 
-        || fabs(colour->r - colour->b) > FUDGE 
-        || fabs(colour->g - colour->b) > FUDGE) {
-            // not greyscale - render in full colour
-            pixel_arr[3 * (i * SCR_WIDTH + x) + 0] = colour->r;
-            pixel_arr[3 * (i * SCR_WIDTH + x) + 1] = colour->g;
-            pixel_arr[3 * (i * SCR_WIDTH + x) + 2] = colour->b;
+        fb->pixels[3 * (i * fb->width + x) + 0] = colour->r;
+        fb->pixels[3 * (i * fb->width + x) + 1] = colour->g;
+        fb->pixels[3 * (i * fb->width + x) + 2] = colour->b;
+    }
+}
+
+/**
+ * Draw a vertical line from (x, y0) to (x, y1) in a greyscale colour with the dithering filter applied.
+ * 
+ * @param fb: The framebuffer.
+ * @param x: The x coordinate of the line.
+ * @param y0: The starting endpoint of the line.
+ * @param y1: The ending endpoint of the line.
+ * @param colour: The colour of the line, which must be greyscale.
+ * @param index: Unused.
+ */
+static void fill_dither(
+    struct framebuffer *fb,
+    const int x,
+    const int y0,
+    const int y1,
+    const struct rgb *colour,
+    const unsigned char index
+) {
+    const float *bayer_row = bayer_matrix[x % BAYER_NUM];
+    for (int i = y0; i < y1; i++) {
+        float lum_out = colour->r + bayer_row[i % BAYER_NUM];
+        float lum = lum_out > 0.5 ? 1.0 : 0.0;
+
+        fb->pixels[3 * (i * fb->width + x) + 0] = lum;
+        fb->pixels[3 * (i * fb->width + x) + 1] = lum;
+        fb->pixels[3 * (i * fb->width + x) + 2] = lum;
+    }
+}
+
+/**
+ * Draw a vertical line from (x, y0) to (x, y1) in a single palette index.
+ * 
+ * @param fb: The framebuffer.
+ * @param x: The x coordinate of the line.
+ * @param y0: The starting endpoint of the line.
+ * @param y1: The ending endpoint of the line.
+ * @param colour: Unused.
+ * @param index: The palette index of the line.
+ */
+static void fill_index(
+    struct framebuffer *fb,
+    const int x,
+    const int y0,
+    const int y1,
+    const struct rgb *colour,
+    const unsigned char index
+) {
+    for (int i = y0; i < y1; i++) {
+        fb->indices[i * fb->width + x] = index;
+    }
+}
+
+/**
+ * Draw a vertical line from (x, y0) to (x, y1) in the pixel buffer. Greyscale colours are dithered,
+ * so the variant is chosen once for the whole line rather than per pixel.
+ * 
+ * @param fb: The framebuffer.
+ * @param pipeline: The render pipeline.
+ * @param x: The x coordinate of the line.
+ * @param y0: The starting endpoint of the line.
+ * @param y1: The ending endpoint of the line.
+ * @param colour: The colour of the line.
+ */
+static void draw_vert(
+    struct framebuffer *fb,
+    const struct pipeline *pipeline,
+    const int x,
+    const int y0,
+    const int y1,
+    const struct rgb *colour
+) {
+    if (fabs(colour->r - colour->g) > FUDGE 
+    || fabs(colour->r - colour->b) > FUDGE 
+    || fabs(colour->g - colour->b) > FUDGE) {
+        // not greyscale - render in full colour
+        pipeline->fill_colour(fb, x, y0, y1, colour, 0);
+    } else {
+        pipeline->fill_grey(fb, x, y0, y1, colour, 0);
+    }
+}
+
+/**
+ * The parameters of a single textured column of a wall.
+ * 
+ * @param texture: The texture of the wall.
+ * @param x: The x coordinate.
+ * @param y0: The bottom of the span on the image plane.
+ * @param y1: The top of the span on the image plane.
+ * @param floor_y: The bottom of the wall on the image plane, extrapolated beyond the screen height.
+ * @param tex_x: The column of the texture that is sampled.
+ * @param height_factor: The world height covered by each pixel of the wall.
+ * @param tex_step: The texture rows covered by each pixel of the wall in fixed point, used by the
+ *                  fixed point variants instead of `height_factor`.
+ * @param intensity: The intensity of the light affecting the wall.
+ * @param shade: The shade table row for the intensity, used by the indexed output style.
+ */
+struct wall_span {
+    const struct texture *texture;
+    int x, y0, y1, floor_y, tex_x;
+    double height_factor;
+    int64_t tex_step;
+    float intensity;
+    const unsigned char *shade;
+};
+
+/**
+ * The inner loop shared by every wall span variant. It is always inlined with constant arguments,
+ * so each variant is compiled with the output style, lighting and texture size folded in.
+ * 
+ * @param fb: The framebuffer.
+ * @param span: The wall span.
+ * @param output: The output style.
+ * @param lit: Whether the span is shaded by its light intensity.
+ * @param fixed_point: Whether the texture rows are stepped in fixed point.
+ * @param tex_width: The width of the texture.
+ * @param tex_height: The height of the texture.
+ */
+static inline __attribute__((always_inline)) void wall_span(
+    struct framebuffer *fb,
+    const struct wall_span *span,
+    const enum output_mode output,
+    const bool lit,
+    const bool fixed_point,
+    const int tex_width,
+    const int tex_height
+) {
+    const struct rgb *texels = span->texture->texels;
+    const unsigned char *indices = span->texture->indices;
+    const float *bayer_row = bayer_matrix[span->x % BAYER_NUM];
+    const int x = span->x, horizon = (fb->height / 2) - span->floor_y;
+    const float intensity = span->intensity;
+    double world_height;
+    int tex_y;
+
+    for (int y = span->y0; y < span->y1; y++) {
+        if (fixed_point) {
+            tex_y = (int) ((abs(y - horizon) * span->tex_step) >> FIXED_BITS) % tex_height;
+        } else {
+            world_height = abs(y - horizon) * span->height_factor;
+            tex_y = (int) (TEX_HEIGHT_DENSITY * tex_height * world_height) % tex_height;
+        }
+        if (output == OUTPUT_INDEXED) {
+            unsigned char index = indices[tex_y * tex_width + span->tex_x];
+            fb->indices[y * fb->width + x] = lit ? span->shade[index] : index;
+            continue;
+        }
+
+        const struct rgb *diffuse_col = &texels[tex_y * tex_width + span->tex_x];
+        float *pixel = &fb->pixels[3 * (y * fb->width + x)];
+
+        if (output == OUTPUT_DITHER) {
+            float greyscale = 0.2126 * diffuse_col->r + 0.7152 * diffuse_col->g + 0.0722 * diffuse_col->b;
+            const struct rgb *colour = ((lit ? greyscale * intensity : greyscale) + bayer_row[y % BAYER_NUM] > BAYER_SENS)
+                ? &light_colour
+                : &dark_colour;
+            pixel[0] = colour->r;
+            pixel[1] = colour->g;
+            pixel[2] = colour->b;
+        } else if (lit) {
+            pixel[0] = intensity * diffuse_col->r;
+            pixel[1] = intensity * diffuse_col->g;
+            pixel[2] = intensity * diffuse_col->b;
         } else {
-            // greyscale - apply dithering filter
-            float lum_out = colour->r + bayer_matrix[x % BAYER_NUM][i % BAYER_NUM];
-            float lum = lum_out > 0.5 ? 1.0 : 0.0;
+            pixel[0] = diffuse_col->r;
+            pixel[1] = diffuse_col->g;
+            pixel[2] = diffuse_col->b;
+        }
+    }
+}
+
+// define a wall span variant with the given output style, lighting, arithmetic and texture size
+#define WALL_SPAN(name, output, lit, fixed_point, tex_width, tex_height) \
+    static void name(struct framebuffer *fb, const struct wall_span *span) { \
+        wall_span(fb, span, output, lit, fixed_point, tex_width, tex_height); \
+    }
+
+// define the variants of every supported texture size for an output style, lighting mode and arithmetic
+#define WALL_SPANS(name, output, lit, fixed_point) \
+    WALL_SPAN(name##_64, output, lit, fixed_point, 64, 64) \
+    WALL_SPAN(name##_128, output, lit, fixed_point, 128, 128) \
+    WALL_SPAN(name##_256, output, lit, fixed_point, 256, 256) \
+    WALL_SPAN(name##_any, output, lit, fixed_point, span->texture->width, span->texture->height) \
+    static const wall_span_fn name[N_TEX_SIZES] = {name##_64, name##_128, name##_256, name##_any};
 
-            pixel_arr[3 * (i * SCR_WIDTH + x) + 0] = lum;
-            pixel_arr[3 * (i * SCR_WIDTH + x) + 1] = lum;
-            pixel_arr[3 * (i * SCR_WIDTH + x) + 2] = lum;
+WALL_SPANS(dither_lit_spans, OUTPUT_DITHER, true, false)
+WALL_SPANS(dither_flat_spans, OUTPUT_DITHER, false, false)
+WALL_SPANS(colour_lit_spans, OUTPUT_COLOUR, true, false)
+WALL_SPANS(colour_flat_spans, OUTPUT_COLOUR, false, false)
+WALL_SPANS(indexed_lit_spans, OUTPUT_INDEXED, true, false)
+WALL_SPANS(indexed_flat_spans, OUTPUT_INDEXED, false, false)
+WALL_SPANS(fixed_dither_lit_spans, OUTPUT_DITHER, true, true)
+WALL_SPANS(fixed_dither_flat_spans, OUTPUT_DITHER, false, true)
+WALL_SPANS(fixed_colour_lit_spans, OUTPUT_COLOUR, true, true)
+WALL_SPANS(fixed_colour_flat_spans, OUTPUT_COLOUR, false, true)
+WALL_SPANS(fixed_indexed_lit_spans, OUTPUT_INDEXED, true, true)
+WALL_SPANS(fixed_indexed_flat_spans, OUTPUT_INDEXED, false, true)
+
+/**
+ * The parameters of a single column of a sprite.
+ * 
+ * @param texture: The sprite texture.
+ * @param x: The x coordinate.
+ * @param y0: The bottom of the span on the image plane.
+ * @param y1: The top of the span on the image plane.
+ * @param tex_x: The column of the texture that is sampled.
+ * @param tex_y0: The row of the texture at the centre of the bottom pixel of the span.
+ * @param tex_step: The number of texture rows covered by each pixel.
+ * @param intensity: The intensity of the light affecting the sprite.
+ * @param shade: The shade table row for the intensity, used by the indexed output style.
+ */
+struct sprite_span {
+    const struct texture *texture;
+    int x, y0, y1, tex_x;
+    float tex_y0, tex_step;
+    float intensity;
+    const unsigned char *shade;
+};
+
+/**
+ * The inner loop shared by every sprite span variant, inlined with a constant output style.
+ * 
+ * @param fb: The framebuffer.
+ * @param span: The sprite span.
+ * @param output: The output style.
+ */
+static inline __attribute__((always_inline)) void sprite_span(
+    struct framebuffer *fb,
+    const struct sprite_span *span,
+    const enum output_mode output
+) {
+    const struct texture *texture = span->texture;
+    const float *bayer_row = bayer_matrix[span->x % BAYER_NUM];
+    const int x = span->x;
+    const float intensity = span->intensity;
+
+    for (int y = span->y0; y < span->y1; y++) {
+        int tex_y = min((int) (span->tex_y0 + (y - span->y0) * span->tex_step), texture->height - 1);
+        const struct rgb *diffuse_col = &texture->texels[tex_y * texture->width + span->tex_x];
+        if (TRANSPARENT(diffuse_col)) {
+            continue;
+        }
+
+        if (output == OUTPUT_INDEXED) {
+            fb->indices[y * fb->width + x] = span->shade[texture->indices[tex_y * texture->width + span->tex_x]];
+            continue;
+        }
+
+        float *pixel = &fb->pixels[3 * (y * fb->width + x)];
+        if (output == OUTPUT_DITHER) {
+            float greyscale = 0.2126 * diffuse_col->r + 0.7152 * diffuse_col->g + 0.0722 * diffuse_col->b;
+            const struct rgb *colour = (greyscale * intensity + bayer_row[y % BAYER_NUM] > BAYER_SENS)
+                ? &light_colour
+                : &dark_colour;
+            pixel[0] = colour->r;
+            pixel[1] = colour->g;
+            pixel[2] = colour->b;
+        } else {
+            pixel[0] = intensity * diffuse_col->r;
+            pixel[1] = intensity * diffuse_col->g;
+            pixel[2] = intensity * diffuse_col->b;
         }
     }
 }
 
+// define a sprite span variant with the given output style
+#define SPRITE_SPAN(name, output) \
+    static void name(struct framebuffer *fb, const struct sprite_span *span) { \
+        sprite_span(fb, span, output); \
+    }
+
+SPRITE_SPAN(dither_sprite_span, OUTPUT_DITHER)
+SPRITE_SPAN(colour_sprite_span, OUTPUT_COLOUR)
+SPRITE_SPAN(indexed_sprite_span, OUTPUT_INDEXED)
+
+/**
+ * The parameters of a single row of a textured floor or ceiling.
+ * 
+ * @param texture: The texture of the plane.
+ * @param y: The y coordinate.
+ * @param x0: The first column of the span.
+ * @param x1: The column after the last column of the span.
+ * @param u: The texture column at the first pixel, in fixed point.
+ * @param v: The texture row at the first pixel, in fixed point.
+ * @param du: The change in the texture column per pixel, in fixed point.
+ * @param dv: The change in the texture row per pixel, in fixed point.
+ * @param intensity: The intensity of the light affecting the row.
+ * @param shade: The shade table row for the intensity, used by the indexed output style.
+ */
+struct plane_span {
+    const struct texture *texture;
+    int y, x0, x1;
+    int64_t u, v, du, dv;
+    float intensity;
+    const unsigned char *shade;
+};
+
+/**
+ * Return the texel of a fixed point texture coordinate, wrapped to the texture size.
+ */
+static inline int wrap_texel(const int64_t coord, const int size) {
+    int texel = (int) (coord >> PLANE_FRAC_BITS) % size;
+    return texel < 0 ? texel + size : texel;
+}
+
+/**
+ * The inner loop shared by every plane span variant, inlined with a constant output style and
+ * texture size. The pixels of a row are contiguous, and are always shaded by the light intensity.
+ * 
+ * @param fb: The framebuffer.
+ * @param span: The plane span.
+ * @param output: The output style.
+ * @param tex_width: The width of the texture.
+ * @param tex_height: The height of the texture.
+ */
+static inline __attribute__((always_inline)) void plane_span(
+    struct framebuffer *fb,
+    const struct plane_span *span,
+    const enum output_mode output,
+    const int tex_width,
+    const int tex_height
+) {
+    const struct rgb *texels = span->texture->texels;
+    const unsigned char *indices = span->texture->indices;
+    const int y = span->y;
+    const float intensity = span->intensity;
+    int64_t u = span->u, v = span->v;
+
+    for (int x = span->x0; x < span->x1; x++, u += span->du, v += span->dv) {
+        int texel = wrap_texel(v, tex_height) * tex_width + wrap_texel(u, tex_width);
+        if (output == OUTPUT_INDEXED) {
+            fb->indices[y * fb->width + x] = span->shade[indices[texel]];
+            continue;
+        }
+
+        const struct rgb *diffuse_col = &texels[texel];
+        float *pixel = &fb->pixels[3 * (y * fb->width + x)];
+        if (output == OUTPUT_DITHER) {
+            float greyscale = 0.2126 * diffuse_col->r + 0.7152 * diffuse_col->g + 0.0722 * diffuse_col->b;
+            const struct rgb *colour = (greyscale * intensity + bayer_matrix[x % BAYER_NUM][y % BAYER_NUM] > BAYER_SENS)
+                ? &light_colour
+                : &dark_colour;
+            pixel[0] = colour->r;
+            pixel[1] = colour->g;
+            pixel[2] = colour->b;
+        } else {
+            pixel[0] = intensity * diffuse_col->r;
+            pixel[1] = intensity * diffuse_col->g;
+            pixel[2] = intensity * diffuse_col->b;
+        }
+    }
+}
+
+// define a plane span variant with the given output style and texture size
+#define PLANE_SPAN(name, output, tex_width, tex_height) \
+    static void name(struct framebuffer *fb, const struct plane_span *span) { \
+        plane_span(fb, span, output, tex_width, tex_height); \
+    }
+
+// define the plane span variants of every supported texture size for an output style
+#define PLANE_SPANS(name, output) \
+    PLANE_SPAN(name##_64, output, 64, 64) \
+    PLANE_SPAN(name##_128, output, 128, 128) \
+    PLANE_SPAN(name##_256, output, 256, 256) \
+    PLANE_SPAN(name##_any, output, span->texture->width, span->texture->height) \
+    static const plane_span_fn name[N_TEX_SIZES] = {name##_64, name##_128, name##_256, name##_any};
+
+PLANE_SPANS(dither_plane_spans, OUTPUT_DITHER)
+PLANE_SPANS(colour_plane_spans, OUTPUT_COLOUR)
+PLANE_SPANS(indexed_plane_spans, OUTPUT_INDEXED)
+
+/**
+ * Return the index of the specialised wall span variant for the given texture.
+ */
+static int tex_size_class(const struct texture *texture) {
+    if (texture->width != texture->height) {
+        return TEX_SIZE_ANY;
+    }
+    switch (texture->width) {
+        case 64: return TEX_SIZE_64;
+        case 128: return TEX_SIZE_128;
+        case 256: return TEX_SIZE_256;
+        default: return TEX_SIZE_ANY;
+    }
+}
+
+void build_pipeline(struct pipeline *pipeline, const struct render_options *options, const struct palette *palette) {
+    const wall_span_fn *spans;
+    const plane_span_fn *plane_spans;
+    // the fog darkens walls through their light intensity, so it needs the shaded variants
+    bool lit = options->lighting == LIGHTING_LAMBERTIAN || options->fog;
+    bool fixed_point = options->fixed_point;
+    switch (options->output) {
+        case OUTPUT_DITHER:
+            spans = fixed_point
+                ? (lit ? fixed_dither_lit_spans : fixed_dither_flat_spans)
+                : (lit ? dither_lit_spans : dither_flat_spans);
+            plane_spans = dither_plane_spans;
+            pipeline->sprite_span = dither_sprite_span;
+            break;
+        case OUTPUT_COLOUR:
+            spans = fixed_point
+                ? (lit ? fixed_colour_lit_spans : fixed_colour_flat_spans)
+                : (lit ? colour_lit_spans : colour_flat_spans);
+            plane_spans = colour_plane_spans;
+            pipeline->sprite_span = colour_sprite_span;
+            break;
+        default:
+            spans = fixed_point
+                ? (lit ? fixed_indexed_lit_spans : fixed_indexed_flat_spans)
+                : (lit ? indexed_lit_spans : indexed_flat_spans);
+            plane_spans = indexed_plane_spans;
+            pipeline->sprite_span = indexed_sprite_span;
+            break;
+    }
+    memcpy(pipeline->wall_spans, spans, sizeof(pipeline->wall_spans));
+    memcpy(pipeline->plane_spans, plane_spans, sizeof(pipeline->plane_spans));
+
+    if (options->output == OUTPUT_INDEXED) {
+        pipeline->fill_colour = fill_index;
+        pipeline->fill_grey = fill_index;
+    } else {
+        // greyscale floors and ceilings are dithered in both RGB output styles
+        pipeline->fill_colour = fill_colour;
+        pipeline->fill_grey = fill_dither;
+    }
+    pipeline->draw_vertices = options->output == OUTPUT_DITHER;
+    pipeline->options = options;
+    pipeline->palette = palette;
+}
+
 /**
  * Draw the given wall onto the given pixel buffer with the corresponding texture and shading applied.
+ * A texture that is not resident is drawn in its flat fallback colour until it has been loaded.
  * 
- * @param pixel_arr: The pixel buffer.
+ * @param fb: The framebuffer.
+ * @param pipeline: The render pipeline.
  * @param camera: The camera.
  * @param wall: The wall to be drawn.
  * @param textures: The array of textures.
@@ -188,7 +649,8 @@ static void draw_vert(float *pixel_arr, const int x, const int y0, const int y1,
  * @param intensity: The intensity of the light affecting the wall.
  */
 static void draw_wall(
-    float *pixel_arr,
+    struct framebuffer *fb,
+    const struct pipeline *pipeline,
     const struct camera *camera,
     const struct sector *sector, 
     const struct wall *wall, 
@@ -202,44 +664,74 @@ static void draw_wall(
     const int x,
     const float intensity
 ) {
-    int tex_x, tex_y, bayer_x = x % BAYER_NUM;
-    double world_height;
+    const struct texture *texture = textures[wall->texture_id];
+    if (texture->texels == NULL) {
+        if (pipeline->options->output == OUTPUT_INDEXED) {
+            const unsigned char *shade = pipeline->palette->shades[shade_level(intensity)];
+            pipeline->fill_colour(fb, x, y0, y1, NULL, shade[texture->fallback_index]);
+        } else {
+            struct rgb colour = {
+                intensity * texture->fallback.r, intensity * texture->fallback.g, intensity * texture->fallback.b
+            };
+            draw_vert(fb, pipeline, x, y0, y1, &colour);
+        }
+        return;
+    }
 
-    // calculate x value of texture
-    float wall_len = wall_length(wall);
-    tex_x = (int) (TEX_WIDTH_DENSITY * TEX_WIDTH * s * wall_len) % TEX_WIDTH;
+    struct wall_span span = {
+        .x = x,
+        .y0 = y0,
+        .y1 = y1,
+        .floor_y = floor_y,
+        .intensity = intensity,
+        .shade = pipeline->palette != NULL ? pipeline->palette->shades[shade_level(intensity)] : NULL
+    };
 
-    // calculate transformation from world plane to image plane
-    double height_factor = (sector->ceil_z - sector->floor_z) / (ceil_y + floor_y);
+    if (pipeline->options->fixed_point) {
+        // the texture rows covered by a pixel are found with one divide, and a mip level is
+        // picked like below. A level of an odd size is not exactly half of the last, so the rows
+        // of the picked level are found again
+        const struct texture *base = texture;
+        fixed wall_height = to_fixed(sector->ceil_z) - to_fixed(sector->floor_z);
+        int64_t rows = (int64_t) max(ceil_y + floor_y, 1) << FIXED_BITS;
+        fixed texels_per_pixel = fixed_div((int64_t) TEX_HEIGHT_DENSITY * texture->height * wall_height, rows);
+        if (pipeline->options->mipmaps) {
+            const struct texture *levels = texture->mips;
+            for (int i = 0; i < texture->n_mips && texels_per_pixel >= 2 * FIXED_ONE; i++) {
+                texture = &levels[i];
+                texels_per_pixel >>= 1;
+            }
+        }
+        span.tex_step = texture == base
+            ? texels_per_pixel
+            : fixed_div((int64_t) TEX_HEIGHT_DENSITY * texture->height * wall_height, rows);
 
-    for (int y = y0; y < y1; y++) {
-        world_height = abs(y - ((SCR_HEIGHT / 2) - floor_y)) * height_factor;
-        
-        tex_y = (int) (TEX_HEIGHT_DENSITY * TEX_HEIGHT * world_height) % TEX_HEIGHT;
-        struct rgb *diffuse_col = textures[wall->texture_id][tex_y * TEX_WIDTH + tex_x];
-    
-        #ifdef BAYER
-        float bayer_threshold = bayer_matrix[bayer_x][y % BAYER_NUM];
-        float greyscale = 0.2126 * diffuse_col->r + 0.7152 * diffuse_col->g + 0.0722 * diffuse_col->b;
-        int lum = (greyscale * intensity) + bayer_threshold > BAYER_SENS ? 1 : 0;
-
-        if (lum) {
-            pixel_arr[3 * (y * SCR_WIDTH + x) + 0] = 235.0 / 255.0;
-            pixel_arr[3 * (y * SCR_WIDTH + x) + 1] = 229.0 / 255.0;
-            pixel_arr[3 * (y * SCR_WIDTH + x) + 2] = 206.0 / 255.0;
-        } else {
-            pixel_arr[3 * (y * SCR_WIDTH + x) + 0] = 46.0 / 255.0;
-            pixel_arr[3 * (y * SCR_WIDTH + x) + 1] = 48.0 / 255.0;
-            pixel_arr[3 * (y * SCR_WIDTH + x) + 2] = 55.0 / 255.0;
+        // s is a fixed point number, which a float holds exactly
+        int64_t along = fixed_mul(to_fixed(s), to_fixed(wall->length));
+        span.tex_x = (int) ((TEX_WIDTH_DENSITY * texture->width * along) >> FIXED_BITS) % texture->width;
+    } else {
+        // calculate transformation from world plane to image plane
+        double height_factor = (sector->ceil_z - sector->floor_z) / (ceil_y + floor_y);
+
+        // the world height covered by a pixel grows with the depth, so distant walls are sampled
+        // from the mip level with the fewest texels that still has at least one texel per pixel
+        if (pipeline->options->mipmaps) {
+            float texels_per_pixel = TEX_HEIGHT_DENSITY * texture->height * height_factor;
+            const struct texture *levels = texture->mips;
+            for (int i = 0; i < texture->n_mips && texels_per_pixel >= 2.0f; i++) {
+                texture = &levels[i];
+                texels_per_pixel *= 0.5f;
+            }
         }
-        #endif
 
-        #ifndef BAYER
-        pixel_arr[3 * (y * SCR_WIDTH + x) + 0] = intensity * diffuse_col->r;
-        pixel_arr[3 * (y * SCR_WIDTH + x) + 1] = intensity * diffuse_col->g;
-        pixel_arr[3 * (y * SCR_WIDTH + x) + 2] = intensity * diffuse_col->b;
-        #endif
+        // calculate x value of texture
+        float wall_len = wall->length;
+        span.tex_x = (int) (TEX_WIDTH_DENSITY * texture->width * s * wall_len) % texture->width;
+        span.height_factor = height_factor;
     }
+    span.texture = texture;
+
+    pipeline->wall_spans[tex_size_class(texture)](fb, &span);
 }
 
 /**
@@ -259,126 +751,112 @@ static float lambertian(
     const struct wall *wall, 
     const float intensity
 ) {
-    struct vec2 n = wall_norm(wall);
+    const struct vec2 *n = &wall->normal;
     struct vec2 q = {
         light_pt->x - (ray->origin->x - depth * ray->direction->x), 
         light_pt->y - (ray->origin->y - depth * ray->direction->y)
     };
     struct vec2 light = normalise(&q);
-    return intensity * max(dot(&light, &n), 0.0);
+    return intensity * max(dot(&light, n), 0.0);
 }
 
 /**
- * Apply the shading model to the wall.
+ * Apply the shading model to the wall. Only the lights that reach the hit point of the wall are
+ * summed, so walls are shadowed from the lights behind other walls at no cost.
  * 
  * @param camera: The camera.
  * @param ray: The light ray.
  * @param lights: The array of lights in the map.
- * @param n_lights: The number of lights in the map.
  * @param depth: The distance from the camera to the wall.
  * @param wall: The wall.
+ * @param s: The hit point, as a fraction of the wall from its starting endpoint.
  * @returns: The resulting light intensity from the shading model calculated from the wall and ray.
  */
 float shade(
     const struct camera *camera,
     const struct ray *ray,
     struct light *const *const lights,
-    const int n_lights,
     const float depth, 
-    const struct wall *wall
+    const struct wall *wall,
+    const float s
 ) {
     float light_intensity = 0.0;
-    for (int i = 0; i < n_lights; i++) {
-        struct light *light = lights[i];
+    for (int i = 0; i < wall->n_lights; i++) {
+        const struct lit_span *span = &wall->lights[i];
+        if (s < span->s0 || s > span->s1) {
+            continue;
+        }
+        struct light *light = lights[span->light];
         light_intensity += lambertian(ray, light->pos, depth, wall, light->intensity);
     }
     light_intensity += lambertian(ray, camera->pos, depth, wall, min(0.4 / powf(depth, 2.0), 1.0));
     return min(AMBIENT + light_intensity, 1.0);
 }
 
-void render(
-    float *pixel_arr,
-    const struct camera *camera,
-    struct sector *const *const sectors,
+/**
+ * Return the fraction of a wall at the given depth that is visible through the distance fog.
+ * 
+ * @param options: The render options.
+ * @param depth: The distance from the camera to the wall.
+ */
+static float fog_visibility(const struct render_options *options, const double depth) {
+    if (!options->fog || depth <= options->fog_start) {
+        return 1.0;
+    }
+    return max(1.0 - (depth - options->fog_start) / (options->max_distance - options->fog_start), 0.0);
+}
+
+/**
+ * Return whether a floor or ceiling with the given texture is textured, and so left to
+ * `draw_planes()`. A texture that is not resident leaves it in its flat colour.
+ */
+static bool textured_plane(texture *textures, const int texture_id) {
+    return texture_id >= 0 && textures[texture_id]->texels != NULL;
+}
+
+/**
+ * Draw the untextured floor and ceiling of a sector on the given x coordinate. The floor and
+ * ceiling darken with the number of portals between the camera and the sector, and with the
+ * distance fog.
+ * 
+ * @param fb: The framebuffer.
+ * @param pipeline: The render pipeline.
+ * @param textures: The array of textures.
+ * @param sector: The sector.
+ * @param x: The x coordinate.
+ * @param floor_y0: The bottom of the floor on the image plane.
+ * @param floor_y1: The top of the floor on the image plane.
+ * @param ceil_y0: The bottom of the ceiling on the image plane.
+ * @param ceil_y1: The top of the ceiling on the image plane.
+ * @param sector_dist: The number of portals between the camera and the sector.
+ * @param visibility: The visibility of the sector through the distance fog.
+ */
+static void draw_flats(
+    struct framebuffer *fb,
+    const struct pipeline *pipeline,
     texture *textures,
-    struct light *const *const lights,
-    const int n_lights,
-    const struct ray *ray,
+    const struct sector *sector,
     const int x,
-    const int sector_id,
-    const double min_t,
-    const int sector_dist
+    const int floor_y0,
+    const int floor_y1,
+    const int ceil_y0,
+    const int ceil_y1,
+    const int sector_dist,
+    const float visibility
 ) {
-    // find the closest hit wall
-    const struct sector *sector = sectors[sector_id];
-    bool hit = false, is_vertex = false;
-    double depth = HUGE_VAL;
-    int hit_sector = sector->id, hit_id;
-    double curr_depth, curr_len;
-
-    for (int i = 0; i < sector->n_walls; i++) {
-        if (intersection(ray, sector->walls[i], min_t, &curr_depth, &curr_len, &is_vertex) && curr_depth < depth) {
-            hit = true;
-            hit_id = i;
-            depth = curr_depth;
+    bool draw_floor = !textured_plane(textures, sector->floor_texture);
+    bool draw_ceil = !textured_plane(textures, sector->ceil_texture);
+    if (pipeline->options->output == OUTPUT_INDEXED) {
+        // the shaded flat colours are a single shade table lookup
+        const unsigned char *shade = pipeline->palette->shades[shade_level((1.0 - SHADING_FAC * sector_dist) * visibility)];
+        if (draw_floor) {
+            pipeline->fill_colour(fb, x, floor_y0, floor_y1, NULL, shade[sector->floor_index]);
         }
+        if (draw_ceil) {
+            pipeline->fill_colour(fb, x, ceil_y0, ceil_y1, NULL, shade[sector->ceil_index]);
+        }
+        return;
     }
-
-    if (!hit) {return;}  // no wall was found: don't draw anything
-
-    // calculate depth effect
-    int ceil_y = (int) (SCR_HEIGHT / 2) * ((sectors[hit_sector]->ceil_z - camera->height) / (depth * RATIO));
-    int floor_y = (int) (SCR_HEIGHT / 2) * ((camera->height - sectors[hit_sector]->floor_z) / (depth * RATIO));
-    int y0 = max((SCR_HEIGHT / 2) - (floor_y), 0);
-    int y1 = min((SCR_HEIGHT / 2) + (ceil_y), SCR_HEIGHT - 1);
-
-    struct wall *hit_wall = (sectors[hit_sector]->walls)[hit_id];
-    // apply shading model to wall
-    float intensity = shade(camera, ray, lights, n_lights, depth, hit_wall);
-
-    if (sector->walls[hit_id]->portal != 0) {
-        // recursively render the other sector
-        render(
-            pixel_arr, 
-            camera, 
-            sectors, 
-            textures, 
-            lights, 
-            n_lights,
-            ray, 
-            x, 
-            sector->walls[hit_id]->portal, 
-            depth + FUDGE, 
-            sector_dist + 1
-        );
-
-        // calculate lintel height and convert to pixel coordinates
-        float new_sector_ceil = sectors[sector->walls[hit_id]->portal]->ceil_z;
-        int lintel_h = (int) (SCR_HEIGHT / 2) * ((new_sector_ceil - camera->height) / (depth * RATIO));
-        int lintel_y =  min((SCR_HEIGHT / 2) + (lintel_h), SCR_HEIGHT - 1);
-        // draw the lintel
-        draw_wall(pixel_arr, camera, sector, hit_wall, textures, depth, curr_len, lintel_y, y1, floor_y, ceil_y, x, intensity);
-        
-        // calculate sill height and convert to pixel coordinates
-        float new_sector_floor = sectors[sector->walls[hit_id]->portal]->floor_z;
-        int sill_h = (int) (SCR_HEIGHT / 2) * ((camera->height - new_sector_floor) / (depth * RATIO));
-        int sill_y = max((SCR_HEIGHT / 2) - sill_h, 0);
-        // draw the sill
-        draw_wall(pixel_arr, camera, sector, hit_wall, textures, depth, curr_len, y0, sill_y, floor_y, ceil_y, x, intensity);
-    }
-    #ifdef BAYER
-    else if (is_vertex) {
-        draw_vert(pixel_arr, x, y0, y1, &vertex_colour);
-    } else {
-        draw_wall(pixel_arr, camera, sector, hit_wall, textures, depth, curr_len, y0, y1, floor_y, ceil_y, x, intensity);
-    }
-    #endif
-    #ifndef BAYER
-    else {
-        draw_wall(pixel_arr, camera, sector, hit_wall, textures, depth, curr_len, y0, y1, floor_y, ceil_y, x, intensity);
-    }
-    #endif
-    // draw floor and ceiling
     struct rgb shaded_floor_colour = {
         sector->floor_colour->r - (sector->floor_colour->r * SHADING_FAC * sector_dist),
         sector->floor_colour->g - (sector->floor_colour->g * SHADING_FAC * sector_dist),
@@ -389,6 +867,496 @@ void render(
         sector->ceil_colour->g - (sector->ceil_colour->g * SHADING_FAC * sector_dist),
         sector->ceil_colour->b - (sector->ceil_colour->b * SHADING_FAC * sector_dist)
     };
-    draw_vert(pixel_arr, x, 0, y0, &shaded_floor_colour);
-    draw_vert(pixel_arr, x, y1, SCR_HEIGHT, &shaded_ceil_colour);
-}
\ No newline at end of file
+    if (visibility < 1.0) {
+        shaded_floor_colour = (struct rgb) {
+            visibility * shaded_floor_colour.r, visibility * shaded_floor_colour.g, visibility * shaded_floor_colour.b
+        };
+        shaded_ceil_colour = (struct rgb) {
+            visibility * shaded_ceil_colour.r, visibility * shaded_ceil_colour.g, visibility * shaded_ceil_colour.b
+        };
+    }
+    if (draw_floor) {
+        draw_vert(fb, pipeline, x, floor_y0, floor_y1, &shaded_floor_colour);
+    }
+    if (draw_ceil) {
+        draw_vert(fb, pipeline, x, ceil_y0, ceil_y1, &shaded_ceil_colour);
+    }
+}
+
+void default_render_options(struct render_options *options) {
+    options->output = OUTPUT_DITHER;
+    options->lighting = LIGHTING_LAMBERTIAN;
+    options->max_portal_depth = MAX_PORTAL_DEPTH;
+    options->max_distance = HUGE_VAL;
+    options->fog = false;
+    options->fog_start = 0.0;
+    options->texture_budget = 0;
+    options->mipmaps = true;
+    options->incremental = true;
+    options->fixed_point = false;
+}
+
+/**
+ * Project a height relative to the camera onto the image plane in fixed point, giving the number
+ * of rows from the middle of the screen. It is rounded towards zero like the floating point
+ * projection, and clamped so that a wall right in front of the camera cannot overflow.
+ * 
+ * @param height: The height relative to the camera.
+ * @param inv_depth: The reciprocal of the depth.
+ * @param focal: The number of rows covered by one unit of height at a depth of one.
+ */
+static int project_fixed(const fixed height, const fixed inv_depth, const fixed focal) {
+    const int64_t limit = (int64_t) 1 << (30 + FIXED_BITS);
+    int64_t rows = ((((int64_t) height * focal) >> FIXED_BITS) * inv_depth) >> FIXED_BITS;
+    return (int) fixed_trunc(max(min(rows, limit), -limit));
+}
+
+/**
+ * The column renderer shared by `render()` and `render_fixed()`. It is always inlined with a
+ * constant `fixed_point`, so each is compiled with only its own arithmetic.
+ * 
+ * @param fb: The framebuffer.
+ * @param pipeline: The render pipeline.
+ * @param camera: The camera.
+ * @param world: The map data.
+ * @param ray: The viewing ray. The fixed point renderer only uses it for lighting.
+ * @param origin: The origin of the viewing ray in fixed point, used by the fixed point renderer.
+ * @param dir: The direction of the viewing ray in fixed point, used by the fixed point renderer.
+ * @param x: The x coordinate of the image plane.
+ * @param columns: Records the depth and the sectors seen through the column.
+ * @param fixed_point: Whether the walls are found and projected in fixed point.
+ */
+static inline __attribute__((always_inline)) void render_column(
+    struct framebuffer *fb,
+    const struct pipeline *pipeline,
+    const struct camera *camera,
+    const struct world *world,
+    const struct ray *ray,
+    const struct fixed_vec2 *origin,
+    const struct fixed_vec2 *dir,
+    const int x,
+    struct column_buffer *columns,
+    const bool fixed_point
+) {
+    struct sector *const *const sectors = world->sectors;
+    texture *textures = world->textures;
+    const struct render_options *options = pipeline->options;
+    const float ratio = (float) fb->height / (float) fb->width;
+    int sector_id = camera->sector;
+    double min_t = FUDGE;
+
+    // in fixed point, the projection divides by the depth through its reciprocal
+    fixed fixed_min_t = 1, camera_z = 0, focal = 0;
+    if (fixed_point) {
+        camera_z = to_fixed(camera->height);
+        focal = fixed_div((int64_t) (fb->height / 2) * fb->width << FIXED_BITS, (int64_t) fb->height << FIXED_BITS);
+    }
+
+    // the sectors are traversed front to back through the portals. Each sector draws the rows
+    // it covers and leaves the opening of its portal as the window into the next sector
+    int clip_y0 = 0, clip_y1 = fb->height;
+    float *column_depth = &columns->depth[x];
+    int *n_windows = &columns->n_windows[x];
+    struct window *windows = &columns->windows[x * columns->max_windows];
+    *column_depth = HUGE_VAL;
+    *n_windows = 0;
+    for (int sector_dist = 0; clip_y0 < clip_y1; sector_dist++) {
+        struct window *window = &windows[(*n_windows)++];
+        *window = (struct window) {sector_id, clip_y0, clip_y1, clip_y0, clip_y1};
+
+        // find the closest hit wall
+        const struct sector *sector = sectors[sector_id];
+        bool hit = false, is_vertex = false, curr_is_vertex;
+        double depth = HUGE_VAL, len;
+        int hit_id;
+        double curr_depth, curr_len;
+        fixed fixed_depth = INT32_MAX, fixed_len, curr_fixed_depth, curr_fixed_len;
+
+        for (int i = 0; i < sector->n_walls; i++) {
+            if (fixed_point) {
+                if (intersection_fixed(origin, dir, sector->walls[i], fixed_min_t, &curr_fixed_depth, &curr_fixed_len, &curr_is_vertex)
+                && curr_fixed_depth < fixed_depth) {
+                    hit = true;
+                    hit_id = i;
+                    fixed_depth = curr_fixed_depth;
+                    fixed_len = curr_fixed_len;
+                    is_vertex = curr_is_vertex;
+                }
+            } else if (intersection(ray, sector->walls[i], min_t, &curr_depth, &curr_len, &curr_is_vertex) && curr_depth < depth) {
+                hit = true;
+                hit_id = i;
+                depth = curr_depth;
+                len = curr_len;
+                is_vertex = curr_is_vertex;
+            }
+        }
+
+        if (!hit) {return;}  // no wall was found: don't draw anything
+
+        // calculate depth effect
+        int ceil_y, floor_y;
+        fixed inv_depth;
+        if (fixed_point) {
+            depth = from_fixed(fixed_depth);
+            len = from_fixed(fixed_len);
+            inv_depth = fixed_div(FIXED_ONE, max(fixed_depth, FIXED_NEAR));
+            ceil_y = project_fixed(to_fixed(sector->ceil_z) - camera_z, inv_depth, focal);
+            floor_y = project_fixed(camera_z - to_fixed(sector->floor_z), inv_depth, focal);
+        } else {
+            ceil_y = (int) (fb->height / 2) * ((sector->ceil_z - camera->height) / (depth * ratio));
+            floor_y = (int) (fb->height / 2) * ((camera->height - sector->floor_z) / (depth * ratio));
+        }
+        int y0 = max((fb->height / 2) - (floor_y), 0);
+        int y1 = min((fb->height / 2) + (ceil_y), fb->height - 1);
+
+        // the floor and ceiling are drawn in the rows that the wall leaves uncovered
+        float visibility = fog_visibility(options, depth);
+        window->floor_y1 = min(min(y0, y1), clip_y1);
+        window->ceil_y0 = max(y1, clip_y0);
+        draw_flats(
+            fb, pipeline, textures, sector, x, 
+            clip_y0, window->floor_y1, 
+            window->ceil_y0, clip_y1, 
+            sector_dist, visibility
+        );
+
+        if (depth > options->max_distance) {
+            // the wall is past the view distance: cull it and everything behind it
+            draw_vert(fb, pipeline, x, max(y0, clip_y0), min(y1, clip_y1), &fog_colour);
+            *column_depth = depth;
+            return;
+        }
+
+        struct wall *hit_wall = sector->walls[hit_id];
+        // apply shading model to wall
+        float intensity = options->lighting == LIGHTING_LAMBERTIAN
+            ? shade(camera, ray, world->lights, depth, hit_wall, len)
+            : 1.0;
+        intensity *= visibility;
+
+        if (hit_wall->portal == 0) {
+            int wall_y0 = max(y0, clip_y0), wall_y1 = min(y1, clip_y1);
+            if (is_vertex && pipeline->draw_vertices) {
+                draw_vert(fb, pipeline, x, wall_y0, wall_y1, &vertex_colour);
+            } else {
+                draw_wall(fb, pipeline, camera, sector, hit_wall, textures, depth, len, wall_y0, wall_y1, floor_y, ceil_y, x, intensity);
+            }
+            *column_depth = depth;
+            return;
+        }
+
+        // calculate lintel height and convert to pixel coordinates
+        const struct sector *next = sectors[hit_wall->portal];
+        int lintel_h = fixed_point
+            ? project_fixed(to_fixed(next->ceil_z) - camera_z, inv_depth, focal)
+            : (int) (fb->height / 2) * ((next->ceil_z - camera->height) / (depth * ratio));
+        int lintel_y = min((fb->height / 2) + (lintel_h), fb->height - 1);
+
+        // calculate sill height and convert to pixel coordinates
+        int sill_h = fixed_point
+            ? project_fixed(camera_z - to_fixed(next->floor_z), inv_depth, focal)
+            : (int) (fb->height / 2) * ((camera->height - next->floor_z) / (depth * ratio));
+        int sill_y = max((fb->height / 2) - sill_h, 0);
+
+        // draw the sill and the lintel
+        draw_wall(
+            fb, pipeline, camera, sector, hit_wall, textures, depth, len, 
+            max(y0, clip_y0), min(min(sill_y, y1), clip_y1), 
+            floor_y, ceil_y, x, intensity
+        );
+        draw_wall(
+            fb, pipeline, camera, sector, hit_wall, textures, depth, len, 
+            max(max(lintel_y, max(y0, sill_y)), clip_y0), min(y1, clip_y1), 
+            floor_y, ceil_y, x, intensity
+        );
+
+        // continue into the next sector through the portal opening
+        clip_y0 = max(max(y0, sill_y), clip_y0);
+        clip_y1 = min(min(lintel_y, y1), clip_y1);
+        if (sector_dist + 1 >= options->max_portal_depth) {
+            // the portal is too deep: cull the sectors behind it
+            draw_vert(fb, pipeline, x, clip_y0, clip_y1, &fog_colour);
+            *column_depth = depth;
+            return;
+        }
+        sector_id = hit_wall->portal;
+        min_t = depth + FUDGE;
+        fixed_min_t = fixed_depth + 1;
+    }
+}
+
+void render(
+    struct framebuffer *fb,
+    const struct pipeline *pipeline,
+    const struct camera *camera,
+    const struct world *world,
+    const struct ray *ray,
+    const int x,
+    struct column_buffer *columns
+) {
+    render_column(fb, pipeline, camera, world, ray, NULL, NULL, x, columns, false);
+}
+
+void render_fixed(
+    struct framebuffer *fb,
+    const struct pipeline *pipeline,
+    const struct camera *camera,
+    const struct world *world,
+    const int x,
+    struct column_buffer *columns
+) {
+    // the viewing ray through the column, as in viewing_ray()
+    fixed u = fixed_div((int64_t) (2 * x + 1) << FIXED_BITS, (int64_t) fb->width << FIXED_BITS) - FIXED_ONE;
+    fixed anglecos = to_fixed(camera->anglecos), anglesin = to_fixed(camera->anglesin);
+    struct fixed_vec2 origin = {to_fixed(camera->pos->x), to_fixed(camera->pos->y)};
+    struct fixed_vec2 dir = {FOCAL_LEN * anglecos + fixed_mul(u, anglesin), FOCAL_LEN * anglesin - fixed_mul(u, anglecos)};
+
+    // the walls are lit in floating point along the same ray
+    struct vec2 direction = {from_fixed(dir.x), from_fixed(dir.y)};
+    struct ray ray = {camera->pos, &direction};
+    render_column(fb, pipeline, camera, world, &ray, &origin, &dir, x, columns, true);
+}
+
+/**
+ * A row of a plane being joined into a span, column by column.
+ * 
+ * @param sector: The sector of the plane, or 0 if the row has no open span.
+ * @param sector_dist: The number of portals between the camera and the sector.
+ * @param ceiling: Whether the plane is the ceiling of the sector rather than the floor.
+ * @param x0: The first column of the span.
+ * @param x1: The column after the last column of the span.
+ */
+struct plane_row {
+    int sector;
+    int sector_dist;
+    bool ceiling;
+    int x0, x1;
+};
+
+/**
+ * Draw the open span of a row of a plane.
+ * 
+ * @param fb: The framebuffer.
+ * @param pipeline: The render pipeline.
+ * @param camera: The camera.
+ * @param world: The map data.
+ * @param row: The row of the plane.
+ * @param y: The y coordinate of the row.
+ */
+static void draw_plane_row(
+    struct framebuffer *fb,
+    const struct pipeline *pipeline,
+    const struct camera *camera,
+    const struct world *world,
+    const struct plane_row *row,
+    const int y
+) {
+    const struct sector *sector = world->sectors[row->sector];
+    const struct texture *texture = world->textures[row->ceiling ? sector->ceil_texture : sector->floor_texture];
+    const float ratio = (float) fb->height / (float) fb->width;
+    const int horizon = fb->height / 2;
+    double depth;
+    int64_t u, v, du, dv;
+
+    if (pipeline->options->fixed_point) {
+        // the same steps as below in fixed point, with twice the rows from the horizon to the
+        // middle of the row kept as an integer
+        fixed camera_z = to_fixed(camera->height);
+        fixed height = row->ceiling ? to_fixed(sector->ceil_z) - camera_z : camera_z - to_fixed(sector->floor_z);
+        int rows = row->ceiling ? 2 * (y - horizon) + 1 : 2 * (horizon - y) - 1;
+        fixed fixed_depth = fixed_div(
+            (int64_t) 2 * horizon * fb->width * abs(height), (int64_t) fb->height * max(rows, 1) << FIXED_BITS
+        );
+
+        fixed step = fixed_div((int64_t) 2 * fixed_depth, (int64_t) fb->width << FIXED_BITS);
+        fixed cam_x = fixed_div(FIXED_ONE, (int64_t) fb->width << FIXED_BITS) - FIXED_ONE;
+        fixed anglecos = to_fixed(camera->anglecos), anglesin = to_fixed(camera->anglesin);
+        fixed world_x = to_fixed(camera->pos->x) - fixed_mul(fixed_depth, anglecos + fixed_mul(cam_x, anglesin));
+        fixed world_y = to_fixed(camera->pos->y) - fixed_mul(fixed_depth, anglesin - fixed_mul(cam_x, anglecos));
+
+        if (pipeline->options->mipmaps) {
+            int64_t texels_per_pixel = (int64_t) TEX_WIDTH_DENSITY * texture->width * step;
+            const struct texture *levels = texture->mips;
+            for (int i = 0; i < texture->n_mips && texels_per_pixel >= 2 * FIXED_ONE; i++) {
+                texture = &levels[i];
+                texels_per_pixel >>= 1;
+            }
+        }
+
+        int64_t scale_u = TEX_WIDTH_DENSITY * texture->width, scale_v = TEX_WIDTH_DENSITY * texture->height;
+        u = world_x * scale_u % ((int64_t) texture->width << PLANE_FRAC_BITS);
+        v = world_y * scale_v % ((int64_t) texture->height << PLANE_FRAC_BITS);
+        du = -((int64_t) step * anglesin * scale_u >> FIXED_BITS);
+        dv = (int64_t) step * anglecos * scale_v >> FIXED_BITS;
+        depth = from_fixed(fixed_depth);
+    } else {
+        // invert the projection of the plane's height to find the depth of the row
+        double height = row->ceiling ? sector->ceil_z - camera->height : camera->height - sector->floor_z;
+        double rows = row->ceiling ? (y + 0.5) - horizon : horizon - (y + 0.5);
+        depth = horizon * fabs(height) / (max(rows, 0.5) * ratio);
+
+        // the viewing rays of the row hit the plane along a line, which is stepped along from x = 0
+        double step = 2.0 * depth / fb->width;
+        double cam_x = WORLD2CAM(0, fb->width);
+        double world_x = camera->pos->x - depth * (camera->anglecos + cam_x * camera->anglesin);
+        double world_y = camera->pos->y - depth * (camera->anglesin - cam_x * camera->anglecos);
+
+        // distant rows are sampled from the mip level closest to one texel per pixel, like walls
+        if (pipeline->options->mipmaps) {
+            float texels_per_pixel = TEX_WIDTH_DENSITY * texture->width * step;
+            const struct texture *levels = texture->mips;
+            for (int i = 0; i < texture->n_mips && texels_per_pixel >= 2.0f; i++) {
+                texture = &levels[i];
+                texels_per_pixel *= 0.5f;
+            }
+        }
+
+        // the coordinates are wrapped once per row and anchored at x = 0, so that a row is drawn
+        // the same however the columns are split into spans
+        double scale_u = TEX_WIDTH_DENSITY * texture->width, scale_v = TEX_WIDTH_DENSITY * texture->height;
+        u = (int64_t) (fmod(world_x * scale_u, texture->width) * (1 << PLANE_FRAC_BITS));
+        v = (int64_t) (fmod(world_y * scale_v, texture->height) * (1 << PLANE_FRAC_BITS));
+        du = (int64_t) (-step * camera->anglesin * scale_u * (1 << PLANE_FRAC_BITS));
+        dv = (int64_t) (step * camera->anglecos * scale_v * (1 << PLANE_FRAC_BITS));
+    }
+
+    float intensity = max(1.0 - SHADING_FAC * row->sector_dist, 0.0) * fog_visibility(pipeline->options, depth);
+    struct plane_span span = {
+        .texture = texture,
+        .y = y,
+        .x0 = row->x0,
+        .x1 = row->x1,
+        .u = u + row->x0 * du,
+        .v = v + row->x0 * dv,
+        .du = du,
+        .dv = dv,
+        .intensity = intensity,
+        .shade = pipeline->palette != NULL ? pipeline->palette->shades[shade_level(intensity)] : NULL
+    };
+    pipeline->plane_spans[tex_size_class(texture)](fb, &span);
+}
+
+/**
+ * Add the rows y0 up to y1 of a plane seen through column x to the spans being joined. A row whose
+ * open span belongs to another plane, or ends before x, has that span drawn first.
+ */
+static void join_plane_rows(
+    struct framebuffer *fb,
+    const struct pipeline *pipeline,
+    const struct camera *camera,
+    const struct world *world,
+    struct plane_row *rows,
+    const struct plane_row *plane,
+    const int y0,
+    const int y1,
+    const int x
+) {
+    for (int y = y0; y < y1; y++) {
+        struct plane_row *row = &rows[y];
+        if (row->sector == plane->sector && row->sector_dist == plane->sector_dist
+        && row->ceiling == plane->ceiling && row->x1 == x) {
+            row->x1++;
+            continue;
+        }
+        if (row->sector != 0) {
+            draw_plane_row(fb, pipeline, camera, world, row, y);
+        }
+        *row = *plane;
+        row->x0 = x;
+        row->x1 = x + 1;
+    }
+}
+
+void draw_planes(
+    struct framebuffer *fb,
+    const struct pipeline *pipeline,
+    const struct camera *camera,
+    const struct world *world,
+    const struct column_buffer *columns,
+    const int x0,
+    const int x1
+) {
+    struct plane_row *rows = malloc(fb->height * sizeof(struct plane_row));
+    for (int y = 0; y < fb->height; y++) {
+        rows[y].sector = 0;
+    }
+
+    for (int x = x0; x < x1; x++) {
+        const struct window *windows = &columns->windows[x * columns->max_windows];
+        for (int i = 0; i < columns->n_windows[x]; i++) {
+            const struct window *window = &windows[i];
+            const struct sector *sector = world->sectors[window->sector];
+            if (textured_plane(world->textures, sector->floor_texture)) {
+                struct plane_row floor = {window->sector, i, false, 0, 0};
+                join_plane_rows(fb, pipeline, camera, world, rows, &floor, window->y0, window->floor_y1, x);
+            }
+            if (textured_plane(world->textures, sector->ceil_texture)) {
+                struct plane_row ceiling = {window->sector, i, true, 0, 0};
+                join_plane_rows(fb, pipeline, camera, world, rows, &ceiling, window->ceil_y0, window->y1, x);
+            }
+        }
+    }
+
+    for (int y = 0; y < fb->height; y++) {
+        if (rows[y].sector != 0) {
+            draw_plane_row(fb, pipeline, camera, world, &rows[y], y);
+        }
+    }
+    free(rows);
+}
+
+void draw_sprites(
+    struct framebuffer *fb,
+    const struct pipeline *pipeline,
+    const struct column_buffer *columns,
+    const struct sprite *sprites,
+    const int n_sprites,
+    const int x0,
+    const int x1
+) {
+    for (int i = 0; i < n_sprites; i++) {
+        const struct sprite *sprite = &sprites[i];
+        const struct texture *texture = sprite->texture;
+        // the columns and rows whose centres lie on the sprite
+        int sprite_x0 = max((int) ceilf(sprite->x0 - 0.5f), x0);
+        int sprite_x1 = min((int) ceilf(sprite->x1 - 0.5f), x1);
+        int sprite_y0 = max((int) ceilf(sprite->y0 - 0.5f), 0);
+        int sprite_y1 = min((int) ceilf(sprite->y1 - 0.5f), fb->height);
+        float tex_step = texture->height / (sprite->y1 - sprite->y0);
+
+        for (int x = sprite_x0; x < sprite_x1; x++) {
+            if (sprite->depth >= columns->depth[x]) {
+                continue;
+            }
+            // find the rows through which the sector of the sprite is seen
+            const struct window *windows = &columns->windows[x * columns->max_windows];
+            int sector_dist = 0;
+            while (sector_dist < columns->n_windows[x] && windows[sector_dist].sector != sprite->sector) {
+                sector_dist++;
+            }
+            if (sector_dist == columns->n_windows[x]) {
+                continue;
+            }
+            const struct window *window = &windows[sector_dist];
+            int y0 = max(sprite_y0, window->y0), y1 = min(sprite_y1, window->y1);
+            if (y0 >= y1) {
+                continue;
+            }
+
+            // sprites darken with the sector like floors and ceilings
+            float intensity = max(1.0 - SHADING_FAC * sector_dist, 0.0) * fog_visibility(pipeline->options, sprite->depth);
+            struct sprite_span span = {
+                .texture = texture,
+                .x = x,
+                .y0 = y0,
+                .y1 = y1,
+                .tex_x = min((int) ((x + 0.5f - sprite->x0) / (sprite->x1 - sprite->x0) * texture->width), texture->width - 1),
+                .tex_y0 = (y0 + 0.5f - sprite->y0) * tex_step,
+                .tex_step = tex_step,
+                .intensity = intensity,
+                .shade = pipeline->palette != NULL ? pipeline->palette->shades[shade_level(intensity)] : NULL
+            };
+            pipeline->sprite_span(fb, &span);
+        }
+    }
+}
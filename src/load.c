@@ -1,4 +1,8 @@
+#ifndef LOAD
+#define LOAD
 #include "load.h"
+#endif
+#include <time.h>
 
 struct sector **load_sectors(const char *filepath, int *n_sectors) {
     #ifdef DEBUG
@@ -13,11 +17,17 @@ struct sector **load_sectors(const char *filepath, int *n_sectors) {
     struct sector **sectors = malloc((*n_sectors + 1) * sizeof(struct sector));
     sectors[0] = NULL;
 
-    int id, n_walls;
+    int id, n_walls, floor_texture, ceil_texture;
     float floor_z, ceil_z, floor_r, floor_g, floor_b, ceil_r, ceil_g, ceil_b;
+    char rest[MAX_LINE_LEN];
     for (int i = 1; i < *n_sectors + 1; i++) {
         fscanf(file, "%d %d %f %f", &id, &n_walls, &floor_z, &ceil_z);
         fscanf(file, "%f %f %f %f %f %f", &floor_r, &floor_g, &floor_b, &ceil_r, &ceil_g, &ceil_b);
+        // the colours may be followed by the floor and ceiling texture ids on the same line
+        if (fgets(rest, sizeof(rest), file) == NULL || sscanf(rest, "%d %d", &floor_texture, &ceil_texture) != 2) {
+            floor_texture = -1;
+            ceil_texture = -1;
+        }
         #ifdef DEBUG
         printf("loading sector %d with %d walls\n", id, n_walls);
         #endif
@@ -26,15 +36,16 @@ struct sector **load_sectors(const char *filepath, int *n_sectors) {
         sector->floor_colour = malloc(sizeof(struct rgb));
         sector->ceil_colour = malloc(sizeof(struct rgb));
         
-        int start_x, start_y, end_x, end_y, portal, tex_id;
+        int portal, tex_id;
+        float start_x, start_y, end_x, end_y;
         for (int j = 0; j < n_walls; j++) {
             struct wall *wall = malloc(sizeof(struct wall));
-            struct vec2i *start = malloc(sizeof(struct vec2i));
-            struct vec2i *end = malloc(sizeof(struct vec2i));
-            fscanf(file, "%d %d %d %d %d %d", &start_x, &start_y, &end_x, &end_y, &portal, &tex_id);
+            struct vec2 *start = malloc(sizeof(struct vec2));
+            struct vec2 *end = malloc(sizeof(struct vec2));
+            fscanf(file, "%f %f %f %f %d %d", &start_x, &start_y, &end_x, &end_y, &portal, &tex_id);
             
             #ifdef DEBUG
-            printf("WALL %d: (%d, %d) to (%d, %d), portal: %d\n", j, start_x, start_y, end_x, end_y, portal);
+            printf("WALL %d: (%g, %g) to (%g, %g), portal: %d\n", j, start_x, start_y, end_x, end_y, portal);
             #endif
             start->x = start_x;
             start->y = start_y;
@@ -44,6 +55,11 @@ struct sector **load_sectors(const char *filepath, int *n_sectors) {
             wall->end = end;
             wall->portal = portal;
             wall->texture_id = tex_id;
+            wall->sector = i;
+            wall->lights = NULL;
+            wall->n_lights = 0;
+            wall->max_lights = 0;
+            wall->dirty = false;
 
             walls[j] = wall;
         }
@@ -60,13 +76,72 @@ struct sector **load_sectors(const char *filepath, int *n_sectors) {
         sector->ceil_colour->r = ceil_r;
         sector->ceil_colour->g = ceil_g;
         sector->ceil_colour->b = ceil_b;
+        sector->floor_texture = floor_texture;
+        sector->ceil_texture = ceil_texture;
+        sector->n_entries = 0;
+        sector->entries = NULL;
+        sector->n_outline = 0;
+        sector->outline = NULL;
+        sector->dirty = false;
+        sector->damaged = false;
+        sector->n_entities = 0;
+        sector->max_entities = 0;
+        sector->entities = NULL;
+        sector->n_lights = 0;
+        sector->max_lights = 0;
+        sector->lights = NULL;
 
         sectors[i] = sector;
     }
+    fclose(file);
 
     return sectors;
 }
 
+/**
+ * Build the mip chain of a texture, halving its size down to a single texel. Each texel of a level
+ * is the average of the opaque texels of the 2x2 block above it, and is only transparent if the
+ * whole block is.
+ */
+static void build_mips(texture texture) {
+    int n_mips = 0;
+    for (int w = texture->width, h = texture->height; w > 1 || h > 1; w = max(w / 2, 1), h = max(h / 2, 1)) {
+        n_mips++;
+    }
+    texture->n_mips = n_mips;
+    texture->mips = n_mips > 0 ? malloc(n_mips * sizeof(struct texture)) : NULL;
+
+    const struct texture *src = texture;
+    for (int i = 0; i < n_mips; i++) {
+        struct texture *level = &texture->mips[i];
+        *level = (struct texture) {
+            max(src->width / 2, 1), max(src->height / 2, 1), NULL, NULL, texture->fallback, 0, 0, NULL
+        };
+        level->texels = malloc(level->width * level->height * sizeof(struct rgb));
+        for (int y = 0; y < level->height; y++) {
+            for (int x = 0; x < level->width; x++) {
+                struct rgb sum = {0.0f, 0.0f, 0.0f};
+                int n_opaque = 0;
+                for (int j = 0; j < 4; j++) {
+                    int src_x = min(2 * x + (j & 1), src->width - 1);
+                    int src_y = min(2 * y + (j >> 1), src->height - 1);
+                    const struct rgb *texel = &src->texels[src_y * src->width + src_x];
+                    if (!TRANSPARENT(texel)) {
+                        sum.r += texel->r;
+                        sum.g += texel->g;
+                        sum.b += texel->b;
+                        n_opaque++;
+                    }
+                }
+                level->texels[y * level->width + x] = n_opaque > 0
+                    ? (struct rgb) {sum.r / n_opaque, sum.g / n_opaque, sum.b / n_opaque}
+                    : (struct rgb) {1.0f, 0.0f, 1.0f};
+            }
+        }
+        src = level;
+    }
+}
+
 texture load_texture(const char *filepath) {
     #ifdef DEBUG
     printf("Loading textures from %s\n", filepath);
@@ -79,25 +154,57 @@ texture load_texture(const char *filepath) {
 
     int width, height, max_colour;
     fscanf(file, "P6\n %d %d %d", &width, &height, &max_colour);
-    if (width != TEX_WIDTH || height != TEX_HEIGHT || max_colour != 255) {
+    if (width <= 0 || height <= 0 || max_colour != 255) {
         fprintf(stderr, "Invalid image format.\n");
+        fclose(file);
         return NULL;
     }
 
     fseek(file, 1, SEEK_CUR);
 
-    texture texture = malloc(TEX_HEIGHT * TEX_WIDTH * sizeof(struct rgb *));
-    for (int y = TEX_HEIGHT - 1; y >= 0; y--) {
-        for (int x = 0; x < TEX_WIDTH; x++) {
-            unsigned char colour[3];
-            fread(colour, 1, 3, file);
-            struct rgb *texel = malloc(sizeof(struct rgb));
-            texel->r = colour[0] / 255.0;
-            texel->g = colour[1] / 255.0;
-            texel->b = colour[2] / 255.0;
-            texture[y * TEX_WIDTH + x] = texel;
+    // read the whole image in one go and decode it from memory
+    size_t n_bytes = (size_t) width * height * 3;
+    unsigned char *data = malloc(n_bytes);
+    if (fread(data, 1, n_bytes, file) != n_bytes) {
+        fprintf(stderr, "Truncated image %s.\n", filepath);
+        free(data);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+
+    texture texture = malloc(sizeof(struct texture));
+    texture->width = width;
+    texture->height = height;
+    texture->texels = malloc(width * height * sizeof(struct rgb));
+    texture->indices = NULL;
+    const unsigned char *colour = data;
+    for (int y = height - 1; y >= 0; y--) {
+        struct rgb *texel = &texture->texels[y * width];
+        for (int x = 0; x < width; x++, colour += 3) {
+            texel[x].r = colour[0] / 255.0;
+            texel[x].g = colour[1] / 255.0;
+            texel[x].b = colour[2] / 255.0;
         }
     }
+    free(data);
+
+    // the average of the opaque texels stands in for the texture while it is not resident
+    double r = 0.0, g = 0.0, b = 0.0;
+    int n_opaque = 0;
+    for (int i = 0; i < width * height; i++) {
+        const struct rgb *texel = &texture->texels[i];
+        if (!TRANSPARENT(texel)) {
+            r += texel->r;
+            g += texel->g;
+            b += texel->b;
+            n_opaque++;
+        }
+    }
+    n_opaque = max(n_opaque, 1);
+    texture->fallback = (struct rgb) {r / n_opaque, g / n_opaque, b / n_opaque};
+    texture->fallback_index = 0;
+    build_mips(texture);
 
     return texture;
 }
@@ -124,20 +231,56 @@ struct light **load_lights(const char *filepath, int *n_lights) {
         
         light->pos = pos;
         light->intensity = intensity;
+        light->dirty = false;
+        light->sector = 0;
+        light->n_walls = 0;
+        light->max_walls = 0;
+        light->walls = NULL;
+        light->n_sectors = 0;
+        light->max_sectors = 0;
+        light->sectors = NULL;
         lights[i] = light;
     }
+    fclose(file);
     return lights;
 }
 
+struct entity *load_entities(const char *filepath, int *n_entities) {
+    #ifdef DEBUG
+    printf("Loading entities from %s\n", filepath);
+    #endif
+    FILE *file;
+    if ((file = fopen(filepath, "r")) == NULL) {
+        perror("load_entities");
+        return NULL;
+    }
+    fscanf(file, "%d", n_entities);
+    struct entity *entities = malloc(max(*n_entities, 1) * sizeof(struct entity));
+
+    float x, y, width, height;
+    int tex_id;
+    for (int i = 0; i < *n_entities; i++) {
+        fscanf(file, "%f %f %f %f %d", &x, &y, &width, &height, &tex_id);
+        entities[i] = (struct entity) {{x, y}, 0, width, height, tex_id, -1};
+    }
+    fclose(file);
+    return entities;
+}
+
 void destroy_sectors(struct sector **sectors, const int n_sectors) {
     for (int i = 1; i < n_sectors + 1; i++) {
         for (int j = 0; j < sectors[i]->n_walls; j++) {
             struct wall *wall = sectors[i]->walls[j];
             free(wall->start);
             free(wall->end);
+            free(wall->lights);
             free(wall);
         }
         free(sectors[i]->walls);
+        free(sectors[i]->entries);
+        free(sectors[i]->outline);
+        free(sectors[i]->entities);
+        free(sectors[i]->lights);
         free(sectors[i]->floor_colour);
         free(sectors[i]->ceil_colour);
         free(sectors[i]);
@@ -146,11 +289,23 @@ void destroy_sectors(struct sector **sectors, const int n_sectors) {
     return;
 }
 
+void destroy_texels(struct texture *texture) {
+    for (int i = 0; i < texture->n_mips; i++) {
+        free(texture->mips[i].texels);
+        free(texture->mips[i].indices);
+    }
+    free(texture->mips);
+    free(texture->texels);
+    free(texture->indices);
+    texture->n_mips = 0;
+    texture->mips = NULL;
+    texture->texels = NULL;
+    texture->indices = NULL;
+}
+
 void destroy_textures(texture *textures, const int n_textures) {
     for (int i = 0; i < n_textures; i++) {
-        for (int j = 0; j < TEX_HEIGHT * TEX_WIDTH; j++){
-            free(textures[i][j]);
-        }        
+        destroy_texels(textures[i]);
         free(textures[i]);
     }
     free(textures);
@@ -161,7 +316,185 @@ void destroy_lights(struct light **lights, const int n_lights) {
     for (int i = 0; i < n_lights; i++) {
         struct light *light = lights[i];
         free(light->pos);
+        free(light->walls);
+        free(light->sectors);
         free(light);
     }
     free(lights);
-}
\ No newline at end of file
+}
+
+struct manifest *load_manifest(const char *filepath) {
+    #ifdef DEBUG
+    printf("Loading asset manifest from %s\n", filepath);
+    #endif
+    FILE *file;
+    if ((file = fopen(filepath, "r")) == NULL) {
+        perror("load_manifest");
+        return NULL;
+    }
+
+    struct manifest *manifest = malloc(sizeof(struct manifest));
+    manifest->n_assets = 0;
+    manifest->n_textures = 0;
+    manifest->load_time = 0.0;
+    manifest->assets = NULL;
+    int capacity = 0, n_maps = 0, n_lights = 0, n_entities = 0;
+
+    char line[2 * MAX_PATH_LEN], type[16], path[MAX_PATH_LEN];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (sscanf(line, "%15s %255s", type, path) != 2 || type[0] == '#') {
+            continue;
+        }
+        if (manifest->n_assets == capacity) {
+            capacity = max(2 * capacity, 8);
+            manifest->assets = realloc(manifest->assets, capacity * sizeof(struct asset));
+        }
+
+        struct asset *asset = &manifest->assets[manifest->n_assets];
+        if (strcmp(type, "map") == 0) {
+            asset->type = ASSET_MAP;
+            n_maps++;
+        } else if (strcmp(type, "lights") == 0) {
+            asset->type = ASSET_LIGHTS;
+            n_lights++;
+        } else if (strcmp(type, "entities") == 0) {
+            asset->type = ASSET_ENTITIES;
+            n_entities++;
+        } else if (strcmp(type, "texture") == 0) {
+            asset->type = ASSET_TEXTURE;
+            asset->id = manifest->n_textures++;
+        } else {
+            fprintf(stderr, "Unknown asset type %s in %s\n", type, filepath);
+            continue;
+        }
+        strcpy(asset->path, path);
+        asset->data = NULL;
+        asset->count = 0;
+        asset->load_time = 0.0;
+        manifest->n_assets++;
+    }
+    fclose(file);
+
+    if (n_maps != 1 || n_lights != 1 || n_entities > 1) {
+        fprintf(stderr, "The manifest %s must list exactly one map and one lights file, and at most one entities file\n", filepath);
+        destroy_manifest(manifest);
+        return NULL;
+    }
+    return manifest;
+}
+
+/**
+ * Return the current time in seconds, measured from an arbitrary point.
+ */
+static double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+void load_asset(struct asset *asset) {
+    double start = now();
+
+    switch (asset->type) {
+        case ASSET_MAP:
+            asset->data = load_sectors(asset->path, &asset->count);
+            break;
+        case ASSET_LIGHTS:
+            asset->data = load_lights(asset->path, &asset->count);
+            break;
+        case ASSET_ENTITIES:
+            asset->data = load_entities(asset->path, &asset->count);
+            break;
+        case ASSET_TEXTURE:
+            asset->data = load_texture(asset->path);
+            break;
+    }
+    asset->load_time = now() - start;
+}
+
+/**
+ * Load a single asset of the manifest. Run as a thread pool job.
+ * 
+ * @param arg: The asset manifest.
+ * @param job: The index of the asset in the manifest.
+ */
+static void load_job(void *arg, const int job) {
+    load_asset(&((struct manifest *) arg)->assets[job]);
+}
+
+bool load_assets(struct manifest *manifest, struct pool *pool, struct world *world) {
+    double start = now();
+    run_pool(pool, load_job, manifest, manifest->n_assets);
+    manifest->load_time = now() - start;
+
+    bool loaded = true;
+    world->textures = calloc(manifest->n_textures, sizeof(texture));
+    world->n_textures = manifest->n_textures;
+    world->entities = NULL;
+    world->n_entities = 0;
+    for (int i = 0; i < manifest->n_assets; i++) {
+        struct asset *asset = &manifest->assets[i];
+        if (asset->data == NULL) {
+            fprintf(stderr, "Error loading %s\n", asset->path);
+            loaded = false;
+            continue;
+        }
+        #ifdef DEBUG
+        printf("Loaded %s in %.2f ms\n", asset->path, asset->load_time * 1000.0);
+        #endif
+
+        switch (asset->type) {
+            case ASSET_MAP:
+                world->sectors = asset->data;
+                world->n_sectors = asset->count;
+                break;
+            case ASSET_LIGHTS:
+                world->lights = asset->data;
+                world->n_lights = asset->count;
+                break;
+            case ASSET_ENTITIES:
+                world->entities = asset->data;
+                world->n_entities = asset->count;
+                break;
+            case ASSET_TEXTURE:
+                world->textures[asset->id] = asset->data;
+                break;
+        }
+    }
+    #ifdef DEBUG
+    printf("Loaded %d assets in %.2f ms\n", manifest->n_assets, manifest->load_time * 1000.0);
+    #endif
+
+    if (!loaded) {
+        for (int i = 0; i < manifest->n_assets; i++) {
+            struct asset *asset = &manifest->assets[i];
+            if (asset->data == NULL) {
+                continue;
+            }
+            switch (asset->type) {
+                case ASSET_MAP:
+                    destroy_sectors(asset->data, asset->count);
+                    break;
+                case ASSET_LIGHTS:
+                    destroy_lights(asset->data, asset->count);
+                    break;
+                case ASSET_ENTITIES:
+                    free(asset->data);
+                    break;
+                case ASSET_TEXTURE:
+                    destroy_texels(asset->data);
+                    free(asset->data);
+                    break;
+            }
+            asset->data = NULL;
+        }
+        free(world->textures);
+        world->textures = NULL;
+    }
+    return loaded;
+}
+
+void destroy_manifest(struct manifest *manifest) {
+    free(manifest->assets);
+    free(manifest);
+}
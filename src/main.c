@@ -1,14 +1,88 @@
+#define GL_SILENCE_DEPRECATION
+#include <GLFW/glfw3.h>
+
 #ifndef GAME
 #define GAME
 #include "game.h"
 #endif
+#ifndef GRAPHICS
+#define GRAPHICS
 #include "graphics.h"
-#include "load.h"
+#endif
+#include "display.h"
+#include "engine.h"
+#include "reload.h"
+#include <unistd.h>
 
 int main(int argc, char *argv[]) {
     #ifdef DEBUG
     int fps = 0;
     #endif
+    // parse the resolution and frame time target
+    int width = DEFAULT_WIDTH, height = DEFAULT_HEIGHT, opt;
+    double target_ms = 0.0;
+    const char *manifest_path = "./content/manifest.txt";
+    bool watch = false;
+    struct render_options options;
+    default_render_options(&options);
+    while ((opt = getopt(argc, argv, "r:t:cpfd:v:gm:wb:nx")) != -1) {
+        switch (opt) {
+            case 'r':
+                if (sscanf(optarg, "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+                    fprintf(stderr, "Error: invalid resolution %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 't':
+                target_ms = atof(optarg);
+                break;
+            case 'c':
+                options.output = OUTPUT_COLOUR;
+                break;
+            case 'p':
+                options.output = OUTPUT_INDEXED;
+                break;
+            case 'f':
+                options.lighting = LIGHTING_FULLBRIGHT;
+                break;
+            case 'd':
+                options.max_portal_depth = max(atoi(optarg), 1);
+                break;
+            case 'v':
+                options.max_distance = atof(optarg);
+                break;
+            case 'g':
+                options.fog = true;
+                break;
+            case 'm':
+                manifest_path = optarg;
+                break;
+            case 'w':
+                watch = true;
+                break;
+            case 'b':
+                options.texture_budget = (size_t) (atof(optarg) * (1 << 20));
+                break;
+            case 'n':
+                options.mipmaps = false;
+                break;
+            case 'x':
+                options.fixed_point = true;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-r WIDTHxHEIGHT] [-t TARGET_MS] [-c | -p] [-f] [-d DEPTH] [-v DISTANCE [-g]] [-m MANIFEST [-w]] [-b BUDGET_MB] [-n] [-x]\n", argv[0]);
+                exit(1);
+        }
+    }
+
+    if (options.fog) {
+        if (isinf(options.max_distance)) {
+            fprintf(stderr, "Error: the fog needs a view distance\n");
+            exit(1);
+        }
+        options.fog_start = FOG_START * options.max_distance;
+    }
+
     if (!glfwInit()) {
         fprintf(stderr, "Error: GLFW failed to initialize\n");
         exit(1);
@@ -18,48 +92,34 @@ int main(int argc, char *argv[]) {
     glfwGetVersion(&major, &minor, &revision);
     printf("Running against GLFW %i.%i.%i\n", major, minor, revision);
 
-    // load sectors and build sector and wall structs
-    int n_sectors;
-    struct sector **sectors = load_sectors("./content/church.txt", &n_sectors);
-    if (sectors == NULL) {
-        fprintf(stderr, "Error loading sectors, exiting...\n");
+    // load the sectors, lights and textures listed in the asset manifest in parallel
+    struct engine *engine = create_engine(manifest_path, &options, 0);
+    if (engine == NULL) {
+        fprintf(stderr, "Error loading assets, exiting...\n");
         exit(1);
     }
+    printf("Loaded %d assets in %.2f ms\n", engine->n_assets, engine->load_time * 1000.0);
+    struct reloader *reloader = watch ? watch_assets(manifest_path) : NULL;
 
-    // load textures
-    int n_textures = 3;
-    texture *textures = malloc(n_textures * sizeof(texture));
-    textures[0] = load_texture("./content/textures/wood.ppm");
-    textures[1] = load_texture("./content/textures/rocks.ppm");
-    textures[2] = load_texture("./content/textures/brick.ppm");
-
-    // load lights
-    int n_lights;
-    struct light **lights = load_lights("./content/churchlights.txt", &n_lights);
-    if (lights == NULL) {
-        fprintf(stderr, "Error loading lights, exiting...\n");
-        exit(1);
-    }
-
-    // initialise pixel buffer storing luminance and alpha
-    float *pixel_arr = malloc(sizeof(float) * SCR_WIDTH * SCR_HEIGHT * 3);
+    // initialise pixel buffer storing luminance and alpha, sized for the full resolution
+    struct framebuffer fb;
+    fb.pixels = malloc(sizeof(float) * width * height * 3);
+    fb.indices = engine->palette != NULL ? malloc(width * height) : NULL;
+    struct resolution res;
+    init_resolution(&res, &fb, width, height, target_ms / 1000.0);
 
     // initialise camera
     struct camera *camera = malloc(sizeof(struct camera));
-    camera->pos = malloc(sizeof(struct vec2));
-    camera->pos->x = 2.0;
-    camera->pos->y = 2.0;
-    camera->angle = PI;
-    camera->anglecos = cos(camera->angle);
-    camera->anglesin = sin(camera->angle);
-    camera->sector = 1;
-    camera->height = CAM_Z + sectors[camera->sector]->floor_z;
+    struct vec2 *pos = malloc(sizeof(struct vec2));
+    pos->x = 2.0;
+    pos->y = 2.0;
+    place_camera(engine, camera, pos, PI, 1);
 
     struct vec2 new = {camera->pos->x, camera->pos->y};
     glfwWindowHint(GLFW_SCALE_FRAMEBUFFER, GLFW_FALSE);
 
     // create the engine window
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "engine", NULL, NULL);
+    GLFWwindow* window = glfwCreateWindow(width, height, "engine", NULL, NULL);
     if (!window)
     {
         // Window or OpenGL context creation failed
@@ -74,23 +134,37 @@ int main(int argc, char *argv[]) {
 
     /* Loop until the user closes the window */
     while (!glfwWindowShouldClose(window)) {
-        process_input(window, camera, sectors, &new);
+        // swap in any content files that were edited, then find the player in the new map
+        if (reloader != NULL && apply_reloads(reloader, engine)) {
+            int sector = find_sector(&engine->world, camera->pos);
+            if (sector == 0) {
+                sector = min(camera->sector, engine->world.n_sectors);
+            }
+            place_camera(engine, camera, camera->pos, camera->angle, sector);
+        }
+
+        process_input(window, camera, engine->world.sectors, &new);
 
         // update the player's location
-        if (update_location(camera, sectors, &new, 0)) {
+        if (update_location(camera, engine->world.sectors, &new, 0)) {
             camera->pos->x = new.x;
             camera->pos->y = new.y;
         }
 
-        /* Render here */
-        for (int x = 0; x < SCR_WIDTH; x++) {
-            struct ray *ray = viewing_ray(camera, x);
-            render(pixel_arr, camera, sectors, textures, lights, n_lights, ray, x, camera->sector, FUDGE, 0);
-            destroy_ray(ray);
-        }
+        /* Render here. Only the columns affected by what changed since the last frame are
+           rendered, so the last frame is presented again while the player stands still */
+        double frame_start = glfwGetTime();
+        int n_rendered = render_frame(engine, camera, &fb);
+
+        // draw pixels, upscaled to the window
+        int window_width, window_height;
+        glfwGetFramebufferSize(window, &window_width, &window_height);
+        present(&fb, engine->palette, window_width, window_height);
 
-        // draw pixels
-        glDrawPixels(SCR_WIDTH, SCR_HEIGHT, GL_RGB, GL_FLOAT, pixel_arr);
+        // pick the resolution of the next frame from the time taken by full frames only
+        if (n_rendered == fb.width) {
+            scale_resolution(&res, &fb, glfwGetTime() - frame_start);
+        }
 
         /* Swap front and back buffers */
         glfwSwapBuffers(window);
@@ -104,12 +178,14 @@ int main(int argc, char *argv[]) {
     }
 
     glfwTerminate();
-    destroy_sectors(sectors, n_sectors);
-    destroy_textures(textures, n_textures);
-    destroy_lights(lights, n_lights);
+    if (reloader != NULL) {
+        stop_watching(reloader);
+    }
+    destroy_engine(engine);
     free(camera->pos);
     free(camera);
-    free(pixel_arr);
+    free(fb.pixels);
+    free(fb.indices);
 
     #ifdef DEBUG
     printf("frames=%d\n", fps);
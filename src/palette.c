@@ -0,0 +1,302 @@
+#ifndef PALETTE
+#define PALETTE
+#include "palette.h"
+#endif
+#ifndef GRAPHICS
+#define GRAPHICS
+#include "graphics.h"
+#endif
+
+/**
+ * A box of histogram bins in the median cut algorithm.
+ *
+ * @param start: The index of the first bin in the box.
+ * @param end: The index after the last bin in the box.
+ * @param count: The number of texels in the box.
+ */
+struct box {
+    int start, end;
+    long count;
+};
+
+/**
+ * A non-empty bin of the colour histogram.
+ *
+ * @param key: The histogram key of the bin.
+ * @param count: The number of texels in the bin.
+ * @param sum: The sum of the colours of the texels in the bin.
+ */
+struct bin {
+    int key;
+    long count;
+    double sum[3];
+};
+
+/**
+ * Return the histogram key of the given colour.
+ */
+static int hist_key(const struct rgb *colour) {
+    const int levels = (1 << HIST_BITS) - 1;
+    int r = (int) (colour->r * levels + 0.5f);
+    int g = (int) (colour->g * levels + 0.5f);
+    int b = (int) (colour->b * levels + 0.5f);
+    return (r << (2 * HIST_BITS)) | (g << HIST_BITS) | b;
+}
+
+/**
+ * Return the value of the given channel of a histogram key.
+ */
+static int key_channel(const int key, const int channel) {
+    return (key >> ((2 - channel) * HIST_BITS)) & ((1 << HIST_BITS) - 1);
+}
+
+/**
+ * Sort the bins of a box along a channel. A channel has only 1 << HIST_BITS values, so the bins are
+ * counting sorted through a scratch array, which keeps bins of the same value in order.
+ */
+static void sort_box(struct bin *bins, const struct box *box, const int channel, struct bin *scratch) {
+    int starts[(1 << HIST_BITS) + 1] = {0};
+    for (int i = box->start; i < box->end; i++) {
+        starts[key_channel(bins[i].key, channel) + 1]++;
+    }
+    for (int v = 0; v < 1 << HIST_BITS; v++) {
+        starts[v + 1] += starts[v];
+    }
+    for (int i = box->start; i < box->end; i++) {
+        scratch[starts[key_channel(bins[i].key, channel)]++] = bins[i];
+    }
+    memcpy(&bins[box->start], scratch, (box->end - box->start) * sizeof(struct bin));
+}
+
+/**
+ * Return the channel along which the box spans the widest range of values.
+ */
+static int widest_channel(const struct bin *bins, const struct box *box, int *range) {
+    int channel = 0;
+    *range = -1;
+    for (int c = 0; c < 3; c++) {
+        int lo = 1 << HIST_BITS, hi = -1;
+        for (int i = box->start; i < box->end; i++) {
+            int v = key_channel(bins[i].key, c);
+            lo = min(lo, v);
+            hi = max(hi, v);
+        }
+        if (hi - lo > *range) {
+            *range = hi - lo;
+            channel = c;
+        }
+    }
+    return channel;
+}
+
+/**
+ * Add a colour to the palette if it is not already in it. Returns false if the colour is not in
+ * the palette and there are already MAX_RESERVED reserved colours, so it was left out.
+ */
+static bool reserve_colour(struct palette *palette, const struct rgb *colour) {
+    for (int i = 0; i < palette->n_colours; i++) {
+        if (palette->colours[i].r == colour->r
+        && palette->colours[i].g == colour->g
+        && palette->colours[i].b == colour->b) {
+            return true;
+        }
+    }
+    if (palette->n_colours < MAX_RESERVED) {
+        palette->colours[palette->n_colours++] = *colour;
+        return true;
+    }
+    return false;
+}
+
+unsigned char nearest_colour(const struct palette *palette, const struct rgb *colour) {
+    int nearest = 0;
+    float best = HUGE_VALF;
+    for (int i = 0; i < palette->n_colours; i++) {
+        float dr = palette->colours[i].r - colour->r;
+        float dg = palette->colours[i].g - colour->g;
+        float db = palette->colours[i].b - colour->b;
+        float dist = dr * dr + dg * dg + db * db;
+        if (dist < best) {
+            best = dist;
+            nearest = i;
+        }
+    }
+    return nearest;
+}
+
+int shade_level(const float intensity) {
+    int level = (int) (intensity * (N_SHADES - 1) + 0.5f);
+    return min(max(level, 0), N_SHADES - 1);
+}
+
+struct palette *build_palette(texture *textures, const int n_textures, struct sector **sectors, const int n_sectors) {
+    struct palette *palette = malloc(sizeof(struct palette));
+    palette->n_colours = 0;
+
+    // black and the first flat colours get their own entries, and the flats left out once the
+    // reserved entries run out are drawn in the nearest colour of the finished palette
+    const struct rgb black = {0.0, 0.0, 0.0};
+    reserve_colour(palette, &black);
+    int n_left_out = 0;
+    for (int i = 1; i < n_sectors + 1; i++) {
+        n_left_out += !reserve_colour(palette, sectors[i]->floor_colour);
+        n_left_out += !reserve_colour(palette, sectors[i]->ceil_colour);
+    }
+    if (n_left_out > 0) {
+        fprintf(stderr, "More than %d flat colours, drawing %d flats in the nearest palette colour\n", MAX_RESERVED - 1, n_left_out);
+    }
+
+    // build the colour histogram of every texel, leaving out the transparent sprite texels
+    struct bin *hist = calloc(HIST_SIZE, sizeof(struct bin));
+    for (int i = 0; i < n_textures; i++) {
+        for (int j = 0; j < textures[i]->width * textures[i]->height; j++) {
+            const struct rgb *texel = &textures[i]->texels[j];
+            if (TRANSPARENT(texel)) {
+                continue;
+            }
+            struct bin *bin = &hist[hist_key(texel)];
+            bin->count++;
+            bin->sum[0] += texel->r;
+            bin->sum[1] += texel->g;
+            bin->sum[2] += texel->b;
+        }
+    }
+    int n_bins = 0;
+    for (int key = 0; key < HIST_SIZE; key++) {
+        if (hist[key].count > 0) {
+            hist[n_bins] = hist[key];
+            hist[n_bins].key = key;
+            n_bins++;
+        }
+    }
+
+    // split the most populated box at its median until the palette is full
+    int max_boxes = PALETTE_SIZE - palette->n_colours;
+    struct box *boxes = malloc(max_boxes * sizeof(struct box));
+    struct bin *scratch = malloc(max(n_bins, 1) * sizeof(struct bin));
+    int n_boxes = 0;
+    if (n_bins > 0) {
+        long total = 0;
+        for (int i = 0; i < n_bins; i++) {
+            total += hist[i].count;
+        }
+        boxes[n_boxes++] = (struct box) {0, n_bins, total};
+    }
+    while (n_boxes < max_boxes) {
+        int split = -1;
+        for (int i = 0; i < n_boxes; i++) {
+            if (boxes[i].end - boxes[i].start > 1 && (split < 0 || boxes[i].count > boxes[split].count)) {
+                split = i;
+            }
+        }
+        if (split < 0) {
+            break;  // every box holds a single colour
+        }
+
+        struct box *box = &boxes[split];
+        int range;
+        sort_box(hist, box, widest_channel(hist, box, &range), scratch);
+
+        long half = 0;
+        int median = box->start;
+        while (median < box->end - 1 && half + hist[median].count <= box->count / 2) {
+            half += hist[median++].count;
+        }
+        median = max(median, box->start + 1);
+        half = 0;
+        for (int i = box->start; i < median; i++) {
+            half += hist[i].count;
+        }
+
+        boxes[n_boxes++] = (struct box) {median, box->end, box->count - half};
+        box->end = median;
+        box->count = half;
+    }
+
+    // each box becomes the average colour of its texels
+    for (int i = 0; i < n_boxes; i++) {
+        double sum[3] = {0.0, 0.0, 0.0};
+        for (int j = boxes[i].start; j < boxes[i].end; j++) {
+            sum[0] += hist[j].sum[0];
+            sum[1] += hist[j].sum[1];
+            sum[2] += hist[j].sum[2];
+        }
+        palette->colours[palette->n_colours++] = (struct rgb) {
+            sum[0] / boxes[i].count,
+            sum[1] / boxes[i].count,
+            sum[2] / boxes[i].count
+        };
+    }
+    free(boxes);
+    free(scratch);
+    free(hist);
+
+    // precompute the closest entry to every histogram bin
+    const float levels = (1 << HIST_BITS) - 1;
+    for (int key = 0; key < HIST_SIZE; key++) {
+        struct rgb colour = {
+            key_channel(key, 0) / levels,
+            key_channel(key, 1) / levels,
+            key_channel(key, 2) / levels
+        };
+        palette->inverse[key] = nearest_colour(palette, &colour);
+    }
+
+    // precompute the shade tables
+    for (int level = 0; level < N_SHADES; level++) {
+        float intensity = (float) level / (N_SHADES - 1);
+        for (int i = 0; i < palette->n_colours; i++) {
+            struct rgb shaded = {
+                intensity * palette->colours[i].r,
+                intensity * palette->colours[i].g,
+                intensity * palette->colours[i].b
+            };
+            palette->shades[level][i] = nearest_colour(palette, &shaded);
+        }
+    }
+
+    #ifdef DEBUG
+    printf("built palette of %d colours from %d histogram bins\n", palette->n_colours, n_bins);
+    #endif
+    return palette;
+}
+
+/**
+ * Quantise the texels of one texture or mip level to the palette.
+ */
+static void quantise_texels(const struct palette *palette, struct texture *texture) {
+    int n_texels = texture->width * texture->height;
+    if (texture->indices == NULL) {
+        texture->indices = malloc(n_texels);
+    }
+    for (int j = 0; j < n_texels; j++) {
+        texture->indices[j] = palette->inverse[hist_key(&texture->texels[j])];
+    }
+}
+
+void apply_palette(const struct palette *palette, texture *textures, const int n_textures, struct sector **sectors, const int n_sectors) {
+    for (int i = 0; i < n_textures; i++) {
+        textures[i]->fallback_index = nearest_colour(palette, &textures[i]->fallback);
+        if (textures[i]->texels == NULL) {
+            continue;
+        }
+        quantise_texels(palette, textures[i]);
+        for (int j = 0; j < textures[i]->n_mips; j++) {
+            quantise_texels(palette, &textures[i]->mips[j]);
+        }
+    }
+
+    for (int i = 1; i < n_sectors + 1; i++) {
+        sectors[i]->floor_index = nearest_colour(palette, sectors[i]->floor_colour);
+        sectors[i]->ceil_index = nearest_colour(palette, sectors[i]->ceil_colour);
+    }
+}
+
+void expand_indices(const struct palette *palette, const unsigned char *indices, float *pixels, const int n_pixels) {
+    for (int i = 0; i < n_pixels; i++) {
+        const struct rgb *colour = &palette->colours[indices[i]];
+        pixels[3 * i + 0] = colour->r;
+        pixels[3 * i + 1] = colour->g;
+        pixels[3 * i + 2] = colour->b;
+    }
+}
@@ -0,0 +1,114 @@
+#ifndef POOL
+#define POOL
+#include "pool.h"
+#endif
+#include <unistd.h>
+
+/**
+ * Claim and run jobs of the current batch until none are left.
+ */
+static void run_jobs(struct pool *pool, job_fn fn, void *arg, const int n_jobs) {
+    int job;
+    while ((job = __sync_fetch_and_add(&pool->next_job, 1)) < n_jobs) {
+        fn(arg, job);
+    }
+}
+
+/**
+ * The main loop of a worker thread.
+ */
+static void *worker(void *data) {
+    struct pool *pool = data;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (pool->generation == seen && !pool->stopping) {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+        if (pool->stopping) {
+            break;
+        }
+        seen = pool->generation;
+        job_fn fn = pool->fn;
+        void *arg = pool->arg;
+        int n_jobs = pool->n_jobs;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_jobs(pool, fn, arg, n_jobs);
+
+        // every worker checks out of the batch, so none can run a stale job in the next one
+        pthread_mutex_lock(&pool->lock);
+        if (++pool->n_finished == pool->n_threads) {
+            pthread_cond_signal(&pool->work_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+struct pool *create_pool(int n_threads) {
+    if (n_threads <= 0) {
+        n_threads = max((int) sysconf(_SC_NPROCESSORS_ONLN), 1);
+    }
+
+    struct pool *pool = malloc(sizeof(struct pool));
+    pool->n_threads = n_threads - 1;
+    pool->threads = malloc(max(pool->n_threads, 1) * sizeof(pthread_t));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+    pool->generation = 0;
+    pool->stopping = false;
+
+    for (int i = 0; i < pool->n_threads; i++) {
+        pthread_create(&pool->threads[i], NULL, worker, pool);
+    }
+    #ifdef DEBUG
+    printf("created thread pool with %d workers\n", pool->n_threads);
+    #endif
+    return pool;
+}
+
+void run_pool(struct pool *pool, job_fn fn, void *arg, const int n_jobs) {
+    if (pool == NULL || pool->n_threads == 0 || n_jobs <= 1) {
+        for (int job = 0; job < n_jobs; job++) {
+            fn(arg, job);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->n_jobs = n_jobs;
+    pool->next_job = 0;
+    pool->n_finished = 0;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    run_jobs(pool, fn, arg, n_jobs);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->n_finished < pool->n_threads) {
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void destroy_pool(struct pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->n_threads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_cond_destroy(&pool->work_done);
+    free(pool->threads);
+    free(pool);
+}
@@ -0,0 +1,290 @@
+#include "engine.h"
+#include "reload.h"
+#include <string.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+/**
+ * Deallocate the data of a loaded asset.
+ */
+static void destroy_asset(struct asset *asset) {
+    switch (asset->type) {
+        case ASSET_MAP:
+            destroy_sectors(asset->data, asset->count);
+            break;
+        case ASSET_LIGHTS:
+            destroy_lights(asset->data, asset->count);
+            break;
+        case ASSET_ENTITIES:
+            free(asset->data);
+            break;
+        case ASSET_TEXTURE:
+            destroy_texels(asset->data);
+            free(asset->data);
+            break;
+    }
+    asset->data = NULL;
+}
+
+/**
+ * Record the modification time and size of the file of an asset, returning whether either changed.
+ */
+static bool stat_asset(struct reloader *reloader, const int i) {
+    struct stat info;
+    if (stat(reloader->manifest->assets[i].path, &info) != 0) {
+        return false;
+    }
+    bool changed = info.st_mtime != reloader->mtimes[i] || info.st_size != reloader->sizes[i];
+    reloader->mtimes[i] = info.st_mtime;
+    reloader->sizes[i] = info.st_size;
+    return changed;
+}
+
+/**
+ * Wait up to the given time for files to change, marking the assets whose files changed.
+ */
+static void wait_for_changes(struct reloader *reloader, const int timeout_ms) {
+    struct manifest *manifest = reloader->manifest;
+    #ifdef __linux__
+    if (reloader->fd != -1) {
+        struct pollfd fds = {reloader->fd, POLLIN, 0};
+        if (poll(&fds, 1, timeout_ms) <= 0) {
+            return;
+        }
+
+        char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+        ssize_t len = read(reloader->fd, buf, sizeof(buf));
+        for (char *ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + ((struct inotify_event *) ptr)->len) {
+            const struct inotify_event *event = (const struct inotify_event *) ptr;
+            for (int i = 0; i < manifest->n_assets && event->len > 0; i++) {
+                if (event->wd == reloader->watches[i] && strcmp(event->name, reloader->names[i]) == 0) {
+                    reloader->changed[i] = true;
+                }
+            }
+        }
+        return;
+    }
+    #endif
+
+    usleep(timeout_ms * 1000);
+    for (int i = 0; i < manifest->n_assets; i++) {
+        if (stat_asset(reloader, i)) {
+            reloader->changed[i] = true;
+        }
+    }
+}
+
+/**
+ * The main loop of the background thread. Changed files are left to settle, so that a file is
+ * parsed once after being written rather than part way through.
+ */
+static void *watcher(void *data) {
+    struct reloader *reloader = data;
+    struct manifest *manifest = reloader->manifest;
+
+    pthread_mutex_lock(&reloader->lock);
+    while (!reloader->stopping) {
+        pthread_mutex_unlock(&reloader->lock);
+        wait_for_changes(reloader, RELOAD_POLL_MS);
+
+        bool any = false;
+        for (int i = 0; i < manifest->n_assets; i++) {
+            any |= reloader->changed[i];
+        }
+        if (any) {
+            wait_for_changes(reloader, RELOAD_SETTLE_MS);
+        }
+
+        for (int i = 0; i < manifest->n_assets; i++) {
+            if (!reloader->changed[i]) {
+                continue;
+            }
+            reloader->changed[i] = false;
+            stat_asset(reloader, i);
+
+            struct asset asset = manifest->assets[i];
+            load_asset(&asset);
+            if (asset.data == NULL) {
+                fprintf(stderr, "Error reloading %s, keeping the loaded version\n", asset.path);
+                continue;
+            }
+            #ifdef DEBUG
+            printf("parsed %s in %.2f ms\n", asset.path, asset.load_time * 1000.0);
+            #endif
+
+            // a newer version replaces one that has not been swapped in yet
+            pthread_mutex_lock(&reloader->lock);
+            if (reloader->pending[i].data != NULL) {
+                destroy_asset(&reloader->pending[i]);
+            }
+            reloader->pending[i] = asset;
+            pthread_mutex_unlock(&reloader->lock);
+        }
+        pthread_mutex_lock(&reloader->lock);
+    }
+    pthread_mutex_unlock(&reloader->lock);
+    return NULL;
+}
+
+struct reloader *watch_assets(const char *manifest_path) {
+    struct manifest *manifest = load_manifest(manifest_path);
+    if (manifest == NULL) {
+        return NULL;
+    }
+
+    struct reloader *reloader = malloc(sizeof(struct reloader));
+    int n = manifest->n_assets;
+    reloader->manifest = manifest;
+    pthread_mutex_init(&reloader->lock, NULL);
+    reloader->stopping = false;
+    reloader->watches = malloc(n * sizeof(int));
+    reloader->names = malloc(n * sizeof(char *));
+    reloader->mtimes = calloc(n, sizeof(time_t));
+    reloader->sizes = calloc(n, sizeof(off_t));
+    reloader->changed = calloc(n, sizeof(bool));
+    reloader->pending = malloc(n * sizeof(struct asset));
+    for (int i = 0; i < n; i++) {
+        reloader->pending[i] = manifest->assets[i];
+        reloader->pending[i].data = NULL;
+        const char *slash = strrchr(manifest->assets[i].path, '/');
+        reloader->names[i] = slash != NULL ? slash + 1 : manifest->assets[i].path;
+        stat_asset(reloader, i);
+    }
+
+    // editors often replace a file rather than write to it, so the directories are watched
+    reloader->fd = -1;
+    #ifdef __linux__
+    reloader->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (reloader->fd == -1) {
+        perror("inotify_init1");
+    }
+    for (int i = 0; i < n && reloader->fd != -1; i++) {
+        char dir[MAX_PATH_LEN] = ".";
+        int len = reloader->names[i] - manifest->assets[i].path;
+        if (len > 0) {
+            snprintf(dir, sizeof(dir), "%.*s", len, manifest->assets[i].path);
+        }
+        reloader->watches[i] = inotify_add_watch(reloader->fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+        if (reloader->watches[i] == -1) {
+            perror(dir);
+            close(reloader->fd);
+            reloader->fd = -1;
+        }
+    }
+    #endif
+    #ifdef DEBUG
+    printf("watching %d assets by %s\n", n, reloader->fd != -1 ? "inotify" : "polling");
+    #endif
+
+    pthread_create(&reloader->thread, NULL, watcher, reloader);
+    return reloader;
+}
+
+/**
+ * Swap a newly parsed asset into the level. Returns whether it was swapped in.
+ */
+static bool apply_asset(struct engine *engine, struct asset *asset) {
+    struct world *world = &engine->world;
+    switch (asset->type) {
+        case ASSET_MAP:
+            reload_sectors(world, asset->data, asset->count);
+            if (engine->palette != NULL) {
+                apply_palette(engine->palette, NULL, 0, world->sectors, world->n_sectors);
+            }
+            break;
+        case ASSET_LIGHTS:
+            reload_lights(world, asset->data, asset->count);
+            break;
+        case ASSET_ENTITIES: {
+            struct entity *entities = asset->data;
+            for (int i = 0; i < asset->count; i++) {
+                if (entities[i].texture_id < 0 || entities[i].texture_id >= world->n_textures) {
+                    fprintf(stderr, "Error: entity %d of %s has an invalid texture id\n", i, asset->path);
+                    destroy_asset(asset);
+                    return false;
+                }
+            }
+            reload_entities(world, entities, asset->count);
+            break;
+        }
+        case ASSET_TEXTURE: {
+            // the palette is kept, so the new texels are quantised to the colours already in it
+            texture tex = asset->data;
+            if (engine->palette != NULL) {
+                apply_palette(engine->palette, &tex, 1, NULL, 0);
+            }
+            if (engine->textures != NULL) {
+                install_texture(engine->textures, world, asset->id, tex);
+                break;
+            }
+            texture old = world->textures[asset->id];
+            world->textures[asset->id] = tex;
+            asset->data = old;
+            destroy_asset(asset);
+            damage_texture(world, asset->id);
+            break;
+        }
+    }
+    asset->data = NULL;
+    return true;
+}
+
+bool apply_reloads(struct reloader *reloader, struct engine *engine) {
+    struct manifest *manifest = reloader->manifest;
+    struct asset *ready = malloc(manifest->n_assets * sizeof(struct asset));
+    int n_ready = 0;
+
+    // the map is swapped in before the lights and entities that are placed in it
+    pthread_mutex_lock(&reloader->lock);
+    for (enum asset_type type = ASSET_MAP; type <= ASSET_TEXTURE; type++) {
+        for (int i = 0; i < manifest->n_assets; i++) {
+            if (reloader->pending[i].type == type && reloader->pending[i].data != NULL) {
+                ready[n_ready++] = reloader->pending[i];
+                reloader->pending[i].data = NULL;
+            }
+        }
+    }
+    pthread_mutex_unlock(&reloader->lock);
+
+    bool applied = false;
+    for (int i = 0; i < n_ready; i++) {
+        if (apply_asset(engine, &ready[i])) {
+            printf("Reloaded %s\n", ready[i].path);
+            applied = true;
+        }
+    }
+    if (applied) {
+        update_world(&engine->world);
+    }
+    free(ready);
+    return applied;
+}
+
+void stop_watching(struct reloader *reloader) {
+    pthread_mutex_lock(&reloader->lock);
+    reloader->stopping = true;
+    pthread_mutex_unlock(&reloader->lock);
+    pthread_join(reloader->thread, NULL);
+
+    if (reloader->fd != -1) {
+        close(reloader->fd);
+    }
+    for (int i = 0; i < reloader->manifest->n_assets; i++) {
+        if (reloader->pending[i].data != NULL) {
+            destroy_asset(&reloader->pending[i]);
+        }
+    }
+    pthread_mutex_destroy(&reloader->lock);
+    free(reloader->watches);
+    free(reloader->names);
+    free(reloader->mtimes);
+    free(reloader->sizes);
+    free(reloader->changed);
+    free(reloader->pending);
+    destroy_manifest(reloader->manifest);
+    free(reloader);
+}
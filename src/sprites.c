@@ -0,0 +1,115 @@
+#ifndef SPRITES
+#define SPRITES
+#include "sprites.h"
+#endif
+
+/**
+ * Order sprites back to front.
+ */
+static int compare_sprites(const void *a, const void *b) {
+    float da = ((const struct sprite *) a)->depth;
+    float db = ((const struct sprite *) b)->depth;
+    return da < db ? 1 : (da > db ? -1 : 0);
+}
+
+struct sprite_set *create_sprite_set(const int n_sectors) {
+    struct sprite_set *set = malloc(sizeof(struct sprite_set));
+    set->n_sectors = n_sectors;
+    set->frame = 0;
+    set->seen = calloc(n_sectors + 1, sizeof(unsigned long));
+    set->x0 = malloc((n_sectors + 1) * sizeof(int));
+    set->x1 = malloc((n_sectors + 1) * sizeof(int));
+    set->n_visible = 0;
+    set->visible = malloc((n_sectors + 1) * sizeof(int));
+    set->n_sprites = 0;
+    set->max_sprites = 0;
+    set->sprites = NULL;
+    return set;
+}
+
+/**
+ * Find the sectors seen through the columns of the frame and the columns they were seen through.
+ */
+static void find_visible(struct sprite_set *set, const struct column_buffer *columns, const int width) {
+    set->frame++;
+    set->n_visible = 0;
+    for (int x = 0; x < width; x++) {
+        const struct window *windows = &columns->windows[x * columns->max_windows];
+        for (int i = 0; i < columns->n_windows[x]; i++) {
+            int sector = windows[i].sector;
+            if (set->seen[sector] != set->frame) {
+                set->seen[sector] = set->frame;
+                set->x0[sector] = x;
+                set->visible[set->n_visible++] = sector;
+            }
+            set->x1[sector] = x + 1;
+        }
+    }
+}
+
+void find_sprites(
+    struct sprite_set *set,
+    const struct camera *camera,
+    const struct world *world,
+    const struct render_options *options,
+    const struct framebuffer *fb,
+    const struct column_buffer *columns
+) {
+    find_visible(set, columns, fb->width);
+    set->n_sprites = 0;
+    if (world->n_entities == 0) {
+        return;
+    }
+
+    // the camera looks along -(cos, sin), and the image plane runs along (sin, -cos)
+    const float half_width = fb->width / 2.0f;
+    for (int i = 0; i < set->n_visible; i++) {
+        const struct sector *sector = world->sectors[set->visible[i]];
+        for (int j = 0; j < sector->n_entities; j++) {
+            const struct entity *entity = &world->entities[sector->entities[j]];
+            if (world->textures[entity->texture_id]->texels == NULL) {
+                // the sprite texture has not been loaded by the texture cache yet
+                continue;
+            }
+            float dx = entity->pos.x - camera->pos->x;
+            float dy = entity->pos.y - camera->pos->y;
+            float depth = -(dx * camera->anglecos + dy * camera->anglesin);
+            if (depth < SPRITE_NEAR || depth > options->max_distance) {
+                continue;
+            }
+
+            float u = -(dx * camera->anglesin - dy * camera->anglecos) / depth;
+            float centre = (u + 1.0f) * half_width;
+            float extent = half_width * entity->width / depth;
+            struct sprite sprite = {
+                world->textures[entity->texture_id],
+                set->visible[i],
+                depth,
+                centre - 0.5f * extent,
+                centre + 0.5f * extent,
+                fb->height / 2.0f + half_width * (sector->floor_z - camera->height) / depth,
+                fb->height / 2.0f + half_width * (sector->floor_z + entity->height - camera->height) / depth
+            };
+            // cull sprites outside the columns their sector was seen through
+            if (sprite.x1 < set->x0[sprite.sector] || sprite.x0 > set->x1[sprite.sector]) {
+                continue;
+            }
+
+            if (set->n_sprites == set->max_sprites) {
+                set->max_sprites = max(2 * set->max_sprites, 64);
+                set->sprites = realloc(set->sprites, set->max_sprites * sizeof(struct sprite));
+            }
+            set->sprites[set->n_sprites++] = sprite;
+        }
+    }
+    qsort(set->sprites, set->n_sprites, sizeof(struct sprite), compare_sprites);
+}
+
+void destroy_sprite_set(struct sprite_set *set) {
+    free(set->seen);
+    free(set->x0);
+    free(set->x1);
+    free(set->visible);
+    free(set->sprites);
+    free(set);
+}
@@ -0,0 +1,1057 @@
+#ifndef GRAPHICS
+#define GRAPHICS
+#include "graphics.h"
+#endif
+#ifndef LOAD
+#define LOAD
+#include "load.h"
+#endif
+#ifndef WORLD
+#define WORLD
+#include "world.h"
+#endif
+
+/**
+ * Return how far the given position is in front of the line of the wall, scaled by the length of
+ * the wall. It is negative behind the line.
+ */
+static double wall_side(const struct wall *wall, const struct vec2 *pos) {
+    double walldir_x = wall->end->x - wall->start->x;
+    double walldir_y = wall->end->y - wall->start->y;
+    return (pos->x - wall->start->x) * walldir_y - (pos->y - wall->start->y) * walldir_x;
+}
+
+/**
+ * Return whether the given position is in front of the wall. Every point of the wall is on the
+ * same line, so a light behind the line cannot light any of it.
+ */
+static bool in_front(const struct wall *wall, const struct vec2 *pos) {
+    return wall_side(wall, pos) > -FUDGE;
+}
+
+/**
+ * Rebuild the normal, length and fixed point endpoints of a wall from its endpoints.
+ */
+static void rebuild_geometry(struct wall *wall) {
+    float walldir_x = wall->end->x - wall->start->x;
+    float walldir_y = wall->end->y - wall->start->y;
+
+    struct vec2 walln = {walldir_y, -walldir_x};
+    wall->normal = normalise(&walln);
+
+    float wall_len_x = fabsf(walldir_x);
+    float wall_len_y = fabsf(walldir_y);
+    wall->length = ALPHA * max(wall_len_x, wall_len_y) + BETA * min(wall_len_x, wall_len_y);
+
+    wall->fixed_start = (struct fixed_vec2) {to_fixed(wall->start->x), to_fixed(wall->start->y)};
+    wall->fixed_dir = (struct fixed_vec2) {
+        to_fixed(wall->end->x) - wall->fixed_start.x, to_fixed(wall->end->y) - wall->fixed_start.y
+    };
+}
+
+/**
+ * Rebuild the outline of a sector from the endpoints of its walls.
+ */
+static void rebuild_outline(struct sector *sector) {
+    int n = sector->n_outline;
+    float *start_x = sector->outline, *start_y = start_x + n, *dir_x = start_y + n, *dir_y = dir_x + n;
+    for (int i = 0; i < n; i++) {
+        if (i >= sector->n_walls) {
+            start_x[i] = start_y[i] = dir_x[i] = dir_y[i] = 0.0f;
+            continue;
+        }
+        const struct wall *wall = sector->walls[i];
+        start_x[i] = wall->start->x;
+        start_y[i] = wall->start->y;
+        dir_x[i] = wall->end->x - wall->start->x;
+        dir_y[i] = wall->end->y - wall->start->y;
+    }
+}
+
+/**
+ * Rebuild whether the camera can walk through a portal. The step up or down into the next sector
+ * must be under a metre, and the next sector must be tall enough to stand in.
+ */
+static void rebuild_passable(const struct world *world, struct wall *wall) {
+    if (wall->portal == 0) {
+        wall->passable = false;
+        return;
+    }
+    const struct sector *sector = world->sectors[wall->sector];
+    const struct sector *next = world->sectors[wall->portal];
+    wall->passable = fabs(sector->floor_z - next->floor_z) < 1.0
+        && next->ceil_z - next->floor_z > CAM_Z + FUDGE;
+}
+
+/**
+ * Order wall endpoints by position, so the copies of a vertex are next to each other.
+ */
+static int compare_endpoints(const void *a, const void *b) {
+    const struct vec2 *p = &((const struct vertex *) a)->pos;
+    const struct vec2 *q = &((const struct vertex *) b)->pos;
+    if (p->x != q->x) {
+        return p->x < q->x ? -1 : 1;
+    }
+    if (p->y != q->y) {
+        return p->y < q->y ? -1 : 1;
+    }
+    return 0;
+}
+
+/**
+ * Build the vertices shared by the walls. The walls and endpoints of every vertex are stored in
+ * two arrays owned by the first vertex.
+ */
+static void build_vertices(struct world *world, const int n_walls) {
+    // sort every endpoint by position, each as a vertex of its own wall
+    struct vertex *endpoints = malloc(max(2 * n_walls, 1) * sizeof(struct vertex));
+    int n_endpoints = 0;
+    for (int i = 1; i < world->n_sectors + 1; i++) {
+        struct sector *sector = world->sectors[i];
+        for (int j = 0; j < sector->n_walls; j++) {
+            struct wall *wall = sector->walls[j];
+            endpoints[n_endpoints++] = (struct vertex) {*wall->start, 1, &sector->walls[j], &wall->start};
+            endpoints[n_endpoints++] = (struct vertex) {*wall->end, 1, &sector->walls[j], &wall->end};
+        }
+    }
+    qsort(endpoints, n_endpoints, sizeof(struct vertex), compare_endpoints);
+
+    struct wall **walls = malloc(max(n_endpoints, 1) * sizeof(struct wall *));
+    struct vec2 **copies = malloc(max(n_endpoints, 1) * sizeof(struct vec2 *));
+    world->vertices = malloc(max(n_endpoints, 1) * sizeof(struct vertex));
+    world->n_vertices = 0;
+    struct vertex *vertex = NULL;
+    for (int i = 0; i < n_endpoints; i++) {
+        if (vertex == NULL || compare_endpoints(&endpoints[i], vertex) != 0) {
+            vertex = &world->vertices[world->n_vertices++];
+            *vertex = (struct vertex) {endpoints[i].pos, 0, &walls[i], &copies[i]};
+        }
+        walls[i] = *endpoints[i].walls;
+        copies[i] = *endpoints[i].endpoints;
+        vertex->n_walls++;
+    }
+    if (world->n_vertices == 0) {
+        world->vertices[0] = (struct vertex) {{0.0, 0.0}, 0, walls, copies};
+    }
+    free(endpoints);
+}
+
+/**
+ * Add an entity to the entity list of its sector.
+ */
+static void add_to_sector(struct world *world, const int entity) {
+    struct entity *e = &world->entities[entity];
+    if (e->sector == 0) {
+        return;
+    }
+    struct sector *sector = world->sectors[e->sector];
+    if (sector->n_entities == sector->max_entities) {
+        sector->max_entities = max(2 * sector->max_entities, 4);
+        sector->entities = realloc(sector->entities, sector->max_entities * sizeof(int));
+    }
+    e->slot = sector->n_entities;
+    sector->entities[sector->n_entities++] = entity;
+}
+
+/**
+ * Remove an entity from the entity list of its sector, moving the last entity of the list into
+ * its slot.
+ */
+static void remove_from_sector(struct world *world, const int entity) {
+    struct entity *e = &world->entities[entity];
+    if (e->sector == 0) {
+        return;
+    }
+    struct sector *sector = world->sectors[e->sector];
+    int last = sector->entities[--sector->n_entities];
+    sector->entities[e->slot] = last;
+    world->entities[last].slot = e->slot;
+}
+
+/**
+ * Return the point of a wall at the given fraction of it from its starting endpoint. The endpoints
+ * are returned exactly, so that the wedges on either side of a vertex meet exactly.
+ */
+static struct vec2 wall_point(const struct wall *wall, const float s) {
+    if (s == 0.0f || s == 1.0f) {
+        return s == 0.0f ? *wall->start : *wall->end;
+    }
+    return (struct vec2) {
+        wall->start->x + s * (wall->end->x - wall->start->x),
+        wall->start->y + s * (wall->end->y - wall->start->y)
+    };
+}
+
+/**
+ * Add the part of a wall that a light reaches to its lit spans, and damage it. The rays through
+ * neighbouring portals reach a wall as touching parts, which are merged into one span. The spans
+ * are kept in order of light and then of start, so that they are the same whatever order the
+ * parts are traced in. The wall is added to the walls of the light the first time the light
+ * reaches it.
+ */
+static void add_lit_span(struct world *world, struct wall *wall, const int light, const float s0, const float s1) {
+    struct vec2 a = wall_point(wall, s0), b = wall_point(wall, s1);
+    damage_area(world, &a, &b, 0.0f);
+
+    // find the spans of the light that touch the part. The lights are traced in order, so the
+    // spans of the light are searched for from the end
+    struct lit_span *spans = wall->lights;
+    int last = wall->n_lights;
+    while (last > 0 && (spans[last - 1].light > light || (spans[last - 1].light == light && spans[last - 1].s0 > s1))) {
+        last--;
+    }
+    int first = last;
+    float lo = s0, hi = s1;
+    while (first > 0 && spans[first - 1].light == light && spans[first - 1].s1 >= s0) {
+        first--;
+        lo = min(lo, spans[first].s0);
+        hi = max(hi, spans[first].s1);
+    }
+
+    // the spans of a light on a wall are next to each other, so a light reaching the wall for the
+    // first time has no span next to the new one
+    if (last == first && !(first > 0 && spans[first - 1].light == light) && !(first < wall->n_lights && spans[first].light == light)) {
+        struct light *l = world->lights[light];
+        if (l->n_walls == l->max_walls) {
+            l->max_walls = max(2 * l->max_walls, 4);
+            l->walls = realloc(l->walls, l->max_walls * sizeof(struct wall *));
+        }
+        l->walls[l->n_walls++] = wall;
+    }
+
+    // replace them with one span covering them all
+    if (last == first) {
+        if (wall->n_lights == wall->max_lights) {
+            wall->max_lights = max(2 * wall->max_lights, 4);
+            wall->lights = realloc(wall->lights, wall->max_lights * sizeof(struct lit_span));
+            spans = wall->lights;
+        }
+        last = first + 1;
+        memmove(&spans[last], &spans[first], (wall->n_lights - first) * sizeof(struct lit_span));
+        wall->n_lights++;
+    }
+    spans[first] = (struct lit_span) {light, lo, hi};
+    memmove(&spans[first + 1], &spans[last], (wall->n_lights - last) * sizeof(struct lit_span));
+    wall->n_lights -= last - first - 1;
+}
+
+/**
+ * Clip a wall to the wedge of rays from a light through the segment from `a` to `b`, giving the
+ * fractions of the wall from its starting endpoint between which it is inside the wedge. Returns
+ * whether any of the wall is inside.
+ */
+static bool clip_to_wedge(
+    const struct wall *wall,
+    const struct vec2 *pos,
+    const struct vec2 *a,
+    const struct vec2 *b,
+    float *s0,
+    float *s1
+) {
+    // the wedge is narrower than a half plane, so it is the points left of the ray through one
+    // edge of the segment and right of the ray through the other
+    double ax = a->x - pos->x, ay = a->y - pos->y, bx = b->x - pos->x, by = b->y - pos->y;
+    if (ax * by - ay * bx < 0.0) {
+        double tx = ax, ty = ay;
+        ax = bx, ay = by, bx = tx, by = ty;
+    }
+    double px = wall->start->x - pos->x, py = wall->start->y - pos->y;
+    double dx = wall->end->x - wall->start->x, dy = wall->end->y - wall->start->y;
+
+    // each side of the wedge is a linear function of the fraction of the wall, so it bounds the
+    // fractions from one side
+    double lo = 0.0, hi = 1.0;
+    double sides[2][2] = {
+        {ax * py - ay * px, ax * dy - ay * dx},
+        {px * by - py * bx, dx * by - dy * bx}
+    };
+    for (int i = 0; i < 2; i++) {
+        double at_start = sides[i][0], slope = sides[i][1];
+        if (fabs(slope) < FUDGE) {
+            if (at_start < -FUDGE) {
+                return false;
+            }
+        } else if (slope > 0.0) {
+            lo = max(lo, -at_start / slope);
+        } else {
+            hi = min(hi, -at_start / slope);
+        }
+    }
+    *s0 = lo;
+    *s1 = hi;
+    return hi - lo > FUDGE;
+}
+
+/**
+ * A wedge of rays from a light that reach a sector through a part of one of its portals that the
+ * light reaches, waiting to be traced into the sector.
+ *
+ * @param sector: The id of the sector.
+ * @param from: The id of the sector the rays come from, or 0 if merged wedges come from several.
+ * @param a: The point on the right edge of the wedge where it leaves the portal.
+ * @param b: The point on the left edge of the wedge where it leaves the portal.
+ */
+struct wedge {
+    int sector;
+    int from;
+    struct vec2 a;
+    struct vec2 b;
+};
+
+/**
+ * Order wedges by sector, so that the wedges into a sector are next to each other.
+ */
+static int compare_wedges(const void *a, const void *b) {
+    const struct wedge *p = a, *q = b;
+    if (p->sector != q->sector) {
+        return p->sector < q->sector ? -1 : 1;
+    }
+    if (p->a.x != q->a.x) {
+        return p->a.x < q->a.x ? -1 : 1;
+    }
+    if (p->a.y != q->a.y) {
+        return p->a.y < q->a.y ? -1 : 1;
+    }
+    return 0;
+}
+
+/**
+ * Add the wedge of rays from a light through the part of a portal between two points to the
+ * wedges to be traced next, growing the array if it is full.
+ */
+static void push_wedge(
+    struct wedge **wedges,
+    int *n,
+    int *capacity,
+    const struct vec2 *pos,
+    const int sector,
+    const int from,
+    const struct vec2 *a,
+    const struct vec2 *b
+) {
+    if (*n == *capacity) {
+        *capacity = max(2 * *capacity, 16);
+        *wedges = realloc(*wedges, *capacity * sizeof(struct wedge));
+    }
+    bool left = (a->x - pos->x) * (b->y - pos->y) - (a->y - pos->y) * (b->x - pos->x) >= 0.0;
+    (*wedges)[(*n)++] = (struct wedge) {sector, from, left ? *a : *b, left ? *b : *a};
+}
+
+/**
+ * Merge the wedges into a sector that share an edge, leaving the merged wedges at the start of
+ * the array. There are only a few wedges into a sector, so the search starts again after each
+ * merge. Returns the number of wedges left.
+ */
+static int merge_wedges(struct wedge *wedges, int n) {
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            if (j != i && wedges[i].b.x == wedges[j].a.x && wedges[i].b.y == wedges[j].a.y) {
+                wedges[i].b = wedges[j].b;
+                wedges[i].from = wedges[i].from == wedges[j].from ? wedges[i].from : 0;
+                wedges[j] = wedges[--n];
+                i = -1;
+                break;
+            }
+        }
+    }
+    return n;
+}
+
+/**
+ * Add a sector to the sectors a light is traced into, and the light to the lights of the sector,
+ * once. A light is traced on its own, so it is the last light of a sector it is already in.
+ */
+static void add_lit_sector(struct world *world, const int light, const int sector_id) {
+    struct sector *sector = world->sectors[sector_id];
+    if (sector->n_lights > 0 && sector->lights[sector->n_lights - 1] == light) {
+        return;
+    }
+    if (sector->n_lights == sector->max_lights) {
+        sector->max_lights = max(2 * sector->max_lights, 4);
+        sector->lights = realloc(sector->lights, sector->max_lights * sizeof(int));
+    }
+    sector->lights[sector->n_lights++] = light;
+
+    struct light *l = world->lights[light];
+    if (l->n_sectors == l->max_sectors) {
+        l->max_sectors = max(2 * l->max_sectors, 4);
+        l->sectors = realloc(l->sectors, l->max_sectors * sizeof(int));
+    }
+    l->sectors[l->n_sectors++] = sector_id;
+}
+
+/**
+ * Give every wall that a light reaches a lit span for it. The walls of the sector holding the
+ * light are lit in full. The light is then traced through the portals one level at a time: every
+ * ray from the light into a sector crosses the convex sector to one of its walls, so each wall
+ * there is lit where it is inside the wedge of those rays, and the portals among them lead to the
+ * wedges of the next level. This stops the light leaking through solid walls.
+ *
+ * Every ray in two wedges that meet at an edge reaches the sector, so the wedges into a sector at
+ * the same level that meet are merged and traced as one. Otherwise the rays split at every vertex
+ * they pass, and an open area is traced once for every path through it. A light outside the map
+ * lights every wall it is in front of, and is traced into no sectors.
+ */
+static void trace_light(struct world *world, const int light) {
+    const struct vec2 *pos = world->lights[light]->pos;
+    int sector_id = find_sector(world, pos);
+    world->lights[light]->sector = sector_id;
+    if (sector_id == 0) {
+        for (int i = 1; i < world->n_sectors + 1; i++) {
+            struct sector *sector = world->sectors[i];
+            for (int j = 0; j < sector->n_walls; j++) {
+                if (in_front(sector->walls[j], pos)) {
+                    add_lit_span(world, sector->walls[j], light, 0.0f, 1.0f);
+                }
+            }
+        }
+        return;
+    }
+
+    struct wedge *level = NULL, *next = NULL;
+    int n_level = 0, n_next = 0, max_level = 0, max_next = 0;
+    struct sector *sector = world->sectors[sector_id];
+    add_lit_sector(world, light, sector_id);
+    for (int i = 0; i < sector->n_walls; i++) {
+        struct wall *wall = sector->walls[i];
+        add_lit_span(world, wall, light, 0.0f, 1.0f);
+        if (wall->portal != 0 && wall_side(wall, pos) > FUDGE) {
+            push_wedge(&level, &n_level, &max_level, pos, wall->portal, sector_id, wall->start, wall->end);
+        }
+    }
+
+    while (n_level > 0) {
+        qsort(level, n_level, sizeof(struct wedge), compare_wedges);
+        n_next = 0;
+        for (int i = 0, j; i < n_level; i = j) {
+            for (j = i; j < n_level && level[j].sector == level[i].sector; j++);
+            int n_merged = merge_wedges(&level[i], j - i);
+
+            // the portals the light came through face away from it. A light on the line of a
+            // portal is in front of it from both sides, so the light only crosses a portal that it
+            // is clearly in front of. A ray never enters a convex sector twice, so the light does
+            // not cross back into the sector it came from either, which a light between the
+            // portals of two sectors whose moved walls no longer meet is in front of both ways
+            sector = world->sectors[level[i].sector];
+            add_lit_sector(world, light, level[i].sector);
+            for (int k = i; k < i + n_merged; k++) {
+                for (int w = 0; w < sector->n_walls; w++) {
+                    struct wall *wall = sector->walls[w];
+                    float s0, s1;
+                    if (!in_front(wall, pos) || !clip_to_wedge(wall, pos, &level[k].a, &level[k].b, &s0, &s1)) {
+                        continue;
+                    }
+                    add_lit_span(world, wall, light, s0, s1);
+                    if (wall->portal != 0 && wall->portal != level[k].from && wall_side(wall, pos) > FUDGE) {
+                        struct vec2 a = wall_point(wall, s0), b = wall_point(wall, s1);
+                        push_wedge(&next, &n_next, &max_next, pos, wall->portal, level[k].sector, &a, &b);
+                    }
+                }
+            }
+        }
+
+        struct wedge *swap = level;
+        level = next;
+        next = swap;
+        n_level = n_next;
+        int swap_max = max_level;
+        max_level = max_next;
+        max_next = swap_max;
+    }
+    free(level);
+    free(next);
+}
+
+/**
+ * Trace every light again from scratch, after the map is replaced or a change reaches every
+ * light. The parts of walls lit before and after are damaged.
+ */
+static void trace_lights(struct world *world) {
+    for (int i = 1; i < world->n_sectors + 1; i++) {
+        struct sector *sector = world->sectors[i];
+        for (int j = 0; j < sector->n_walls; j++) {
+            struct wall *wall = sector->walls[j];
+            for (int k = 0; k < wall->n_lights; k++) {
+                struct vec2 a = wall_point(wall, wall->lights[k].s0), b = wall_point(wall, wall->lights[k].s1);
+                damage_area(world, &a, &b, 0.0f);
+            }
+            wall->n_lights = 0;
+        }
+        sector->n_lights = 0;
+    }
+    for (int i = 0; i < world->n_lights; i++) {
+        world->lights[i]->n_walls = 0;
+        world->lights[i]->n_sectors = 0;
+        trace_light(world, i);
+    }
+}
+
+/**
+ * Remove the lit spans of a light from the walls it lights, damaging the parts of the walls it
+ * lit, and the light from the sectors it is traced into. The spans of a wall are in order of
+ * light, so the spans of the light are found by bisection, and the spans after them are moved
+ * down over them. Removing several lights from the last makes the spans moved the fewest.
+ */
+static void remove_lit_spans(struct world *world, const int light) {
+    struct light *l = world->lights[light];
+    for (int i = 0; i < l->n_walls; i++) {
+        struct wall *wall = l->walls[i];
+        struct lit_span *spans = wall->lights;
+        int first = 0, last = wall->n_lights;
+        while (first < last) {
+            int mid = (first + last) / 2;
+            if (spans[mid].light < light) {
+                first = mid + 1;
+            } else {
+                last = mid;
+            }
+        }
+        for (last = first; last < wall->n_lights && spans[last].light == light; last++) {
+            struct vec2 a = wall_point(wall, spans[last].s0), b = wall_point(wall, spans[last].s1);
+            damage_area(world, &a, &b, 0.0f);
+        }
+        memmove(&spans[first], &spans[last], (wall->n_lights - last) * sizeof(struct lit_span));
+        wall->n_lights -= last - first;
+    }
+
+    // the lights of a sector are mostly in the order they were traced in, so the light is
+    // searched for from the end
+    for (int i = 0; i < l->n_sectors; i++) {
+        struct sector *sector = world->sectors[l->sectors[i]];
+        int k = sector->n_lights - 1;
+        while (sector->lights[k] != light) {
+            k--;
+        }
+        sector->lights[k] = sector->lights[--sector->n_lights];
+    }
+    l->n_walls = 0;
+    l->n_sectors = 0;
+}
+
+/**
+ * Order light ids from the first.
+ */
+static int compare_lights(const void *a, const void *b) {
+    const int p = *(const int *) a, q = *(const int *) b;
+    return p < q ? -1 : p > q;
+}
+
+/**
+ * Index the sectors by the textures of their walls, floors and ceilings, so that a texture
+ * streamed in or out only damages the sectors drawn with it. Each sector is listed once for each
+ * texture it is drawn with, in order of id, so the last sector listed for a texture shows whether
+ * the sector is listed already. Texture ids outside the texture array are left out.
+ */
+static void build_texture_index(struct world *world) {
+    int n_textures = world->n_textures;
+    int *starts = calloc(n_textures + 1, sizeof(int));
+    int *last = calloc(max(n_textures, 1), sizeof(int));
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 1; i < world->n_sectors + 1; i++) {
+            const struct sector *sector = world->sectors[i];
+            for (int j = -2; j < (int) sector->n_walls; j++) {
+                int id = j == -2 ? sector->floor_texture : j == -1 ? sector->ceil_texture : sector->walls[j]->texture_id;
+                if (id < 0 || id >= n_textures || last[id] == i) {
+                    continue;
+                }
+                last[id] = i;
+                if (pass == 0) {
+                    starts[id + 1]++;
+                } else {
+                    world->texture_sectors[starts[id]++] = i;
+                }
+            }
+        }
+
+        // the counts become the start of each texture, which filling the index moves to its end
+        if (pass == 0) {
+            for (int id = 0; id < n_textures; id++) {
+                starts[id + 1] += starts[id];
+                last[id] = 0;
+            }
+            world->texture_sectors = malloc(max(starts[n_textures], 1) * sizeof(int));
+        }
+    }
+    for (int id = n_textures; id > 0; id--) {
+        starts[id] = starts[id - 1];
+    }
+    starts[0] = 0;
+    world->texture_starts = starts;
+    free(last);
+}
+
+void build_world(struct world *world) {
+    int n_walls = 0;
+    for (int i = 1; i < world->n_sectors + 1; i++) {
+        struct sector *sector = world->sectors[i];
+        for (int j = 0; j < sector->n_walls; j++) {
+            struct wall *wall = sector->walls[j];
+            rebuild_geometry(wall);
+            if (wall->portal != 0) {
+                world->sectors[wall->portal]->n_entries++;
+            }
+        }
+        n_walls += sector->n_walls;
+    }
+
+    // index the portals by the sector they lead into
+    for (int i = 1; i < world->n_sectors + 1; i++) {
+        struct sector *sector = world->sectors[i];
+        sector->entries = malloc(max(sector->n_entries, 1) * sizeof(struct wall *));
+        sector->n_entries = 0;
+        sector->n_outline = max((sector->n_walls + WALL_LANES - 1) / WALL_LANES * WALL_LANES, WALL_LANES);
+        sector->outline = malloc(4 * sector->n_outline * sizeof(float));
+        rebuild_outline(sector);
+    }
+    for (int i = 1; i < world->n_sectors + 1; i++) {
+        struct sector *sector = world->sectors[i];
+        for (int j = 0; j < sector->n_walls; j++) {
+            struct wall *wall = sector->walls[j];
+            rebuild_passable(world, wall);
+            if (wall->portal != 0) {
+                struct sector *next = world->sectors[wall->portal];
+                next->entries[next->n_entries++] = wall;
+            }
+        }
+    }
+    build_vertices(world, n_walls);
+    build_texture_index(world);
+
+    // bucket the entities by the sector they are in
+    for (int i = 0; i < world->n_entities; i++) {
+        world->entities[i].sector = find_sector(world, &world->entities[i].pos);
+        if (world->entities[i].sector == 0) {
+            fprintf(stderr, "Entity %d at (%g, %g) is outside the map\n", i, world->entities[i].pos.x, world->entities[i].pos.y);
+        }
+        add_to_sector(world, i);
+    }
+
+    // each sector, wall and light is queued at most once, so the queues never grow
+    struct changes *changes = malloc(sizeof(struct changes));
+    changes->n_sectors = 0;
+    changes->sectors = malloc(max(world->n_sectors, 1) * sizeof(int));
+    changes->n_walls = 0;
+    changes->walls = malloc(max(n_walls, 1) * sizeof(struct wall *));
+    changes->n_lights = 0;
+    changes->lights = malloc(max(world->n_lights, 1) * sizeof(int));
+    changes->damaged_all = true;
+    changes->n_damaged = 0;
+    changes->damaged = malloc(max(world->n_sectors, 1) * sizeof(int));
+    changes->n_areas = 0;
+    changes->max_areas = 0;
+    changes->areas = NULL;
+    world->changes = changes;
+
+    // the lights are traced through the portals, so they need the portals and the sectors of
+    // the lights found first
+    trace_lights(world);
+
+    #ifdef DEBUG
+    printf("built world with %d walls and %d vertices\n", n_walls, world->n_vertices);
+    #endif
+}
+
+int find_vertex(const struct world *world, const struct vec2 *pos) {
+    for (int i = 0; i < world->n_vertices; i++) {
+        if (world->vertices[i].pos.x == pos->x && world->vertices[i].pos.y == pos->y) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int find_sector(const struct world *world, const struct vec2 *pos) {
+    // the sectors are convex, so a point inside is in front of every wall
+    for (int i = 1; i < world->n_sectors + 1; i++) {
+        const struct sector *sector = world->sectors[i];
+        bool inside = true;
+        for (int j = 0; j < sector->n_walls && inside; j++) {
+            inside = in_front(sector->walls[j], pos);
+        }
+        if (inside) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Queue a wall to have its derived data rebuilt.
+ */
+static void queue_wall(struct world *world, struct wall *wall) {
+    if (!wall->dirty) {
+        wall->dirty = true;
+        world->changes->walls[world->changes->n_walls++] = wall;
+    }
+}
+
+void damage_sector(struct world *world, const int sector) {
+    if (sector == 0 || world->sectors[sector]->damaged) {
+        return;
+    }
+    world->sectors[sector]->damaged = true;
+    world->changes->damaged[world->changes->n_damaged++] = sector;
+}
+
+void damage_area(struct world *world, const struct vec2 *a, const struct vec2 *b, const float radius) {
+    // nothing is kept when the whole world is redrawn, so the areas are not needed
+    struct changes *changes = world->changes;
+    if (changes->damaged_all) {
+        return;
+    }
+    if (changes->n_areas == changes->max_areas) {
+        changes->max_areas = max(2 * changes->max_areas, 16);
+        changes->areas = realloc(changes->areas, changes->max_areas * sizeof(struct area));
+    }
+    changes->areas[changes->n_areas++] = (struct area) {*a, *b, radius};
+}
+
+/**
+ * Queue an entity to be redrawn where it is, as a circle around it that its sprite never leaves.
+ */
+static void damage_entity(struct world *world, const struct entity *entity) {
+    if (entity->sector != 0) {
+        damage_area(world, &entity->pos, &entity->pos, 0.5f * entity->width);
+    }
+}
+
+void damage_texture(struct world *world, const int texture_id) {
+    for (int i = world->texture_starts[texture_id]; i < world->texture_starts[texture_id + 1]; i++) {
+        damage_sector(world, world->texture_sectors[i]);
+    }
+
+    // entities move between sectors, so they are not indexed
+    for (int i = 0; i < world->n_entities; i++) {
+        if (world->entities[i].texture_id == texture_id) {
+            damage_entity(world, &world->entities[i]);
+        }
+    }
+}
+
+void damage_world(struct world *world) {
+    world->changes->damaged_all = true;
+}
+
+void clear_damage(struct world *world) {
+    struct changes *changes = world->changes;
+    for (int i = 0; i < changes->n_damaged; i++) {
+        world->sectors[changes->damaged[i]]->damaged = false;
+    }
+    changes->n_damaged = 0;
+    changes->n_areas = 0;
+    changes->damaged_all = false;
+}
+
+void move_vertex(struct world *world, const int vertex, const struct vec2 *pos) {
+    struct vertex *v = &world->vertices[vertex];
+    v->pos = *pos;
+    for (int i = 0; i < v->n_walls; i++) {
+        *v->endpoints[i] = *pos;
+        queue_wall(world, v->walls[i]);
+        damage_sector(world, v->walls[i]->sector);
+    }
+}
+
+void set_sector_heights(struct world *world, const int sector, const float floor_z, const float ceil_z) {
+    struct sector *s = world->sectors[sector];
+    s->floor_z = floor_z;
+    s->ceil_z = ceil_z;
+    if (!s->dirty) {
+        s->dirty = true;
+        world->changes->sectors[world->changes->n_sectors++] = sector;
+    }
+
+    // the sectors with a portal into the sector draw its heights in their sills and lintels
+    damage_sector(world, sector);
+    for (int i = 0; i < s->n_entries; i++) {
+        damage_area(world, s->entries[i]->start, s->entries[i]->end, 0.0f);
+    }
+}
+
+/**
+ * Queue a light to have the walls it lights rebuilt and redrawn.
+ */
+static void queue_light(struct world *world, const int light) {
+    struct light *l = world->lights[light];
+    if (!l->dirty) {
+        l->dirty = true;
+        world->changes->lights[world->changes->n_lights++] = light;
+    }
+}
+
+void move_light(struct world *world, const int light, const struct vec2 *pos) {
+    *world->lights[light]->pos = *pos;
+    queue_light(world, light);
+}
+
+void set_light_intensity(struct world *world, const int light, const float intensity) {
+    world->lights[light]->intensity = intensity;
+    queue_light(world, light);
+}
+
+int add_entity(struct world *world, const struct entity *entity) {
+    int id = world->n_entities++;
+    world->entities = realloc(world->entities, world->n_entities * sizeof(struct entity));
+    world->entities[id] = *entity;
+    world->entities[id].sector = find_sector(world, &entity->pos);
+    add_to_sector(world, id);
+    damage_entity(world, &world->entities[id]);
+    return id;
+}
+
+void move_entity(struct world *world, const int entity, const struct vec2 *pos, const int sector) {
+    struct entity *e = &world->entities[entity];
+    damage_entity(world, e);
+    e->pos = *pos;
+    if (e->sector != sector) {
+        remove_from_sector(world, entity);
+        e->sector = sector;
+        add_to_sector(world, entity);
+    }
+    damage_entity(world, e);
+}
+
+/**
+ * Return whether a newly loaded map has the same sectors, walls and portals as the world, so that
+ * the world can be turned into it by moving vertices and changing heights.
+ */
+static bool same_shape(const struct world *world, struct sector *const *sectors, const int n_sectors) {
+    if (n_sectors != world->n_sectors) {
+        return false;
+    }
+    for (int i = 1; i < n_sectors + 1; i++) {
+        if (sectors[i]->n_walls != world->sectors[i]->n_walls) {
+            return false;
+        }
+        for (int j = 0; j < sectors[i]->n_walls; j++) {
+            if (sectors[i]->walls[j]->portal != world->sectors[i]->walls[j]->portal) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Return the index of a wall in its sector.
+ */
+static int wall_index(const struct sector *sector, const struct wall *wall) {
+    int i = 0;
+    while (sector->walls[i] != wall) {
+        i++;
+    }
+    return i;
+}
+
+/**
+ * Deallocate the data derived from the map that is not stored in the sectors and walls.
+ */
+static void destroy_derived(struct world *world) {
+    free(world->vertices[0].walls);
+    free(world->vertices[0].endpoints);
+    free(world->vertices);
+    free(world->texture_starts);
+    free(world->texture_sectors);
+    free(world->changes->sectors);
+    free(world->changes->walls);
+    free(world->changes->lights);
+    free(world->changes->damaged);
+    free(world->changes->areas);
+    free(world->changes);
+}
+
+/**
+ * Return whether two colours are the same.
+ */
+static bool same_colour(const struct rgb *a, const struct rgb *b) {
+    return a->r == b->r && a->g == b->g && a->b == b->b;
+}
+
+void reload_sectors(struct world *world, struct sector **sectors, const int n_sectors) {
+    // find where each vertex has moved to, as long as all of its copies still agree
+    bool incremental = same_shape(world, sectors, n_sectors);
+    struct vec2 *moved = malloc(max(world->n_vertices, 1) * sizeof(struct vec2));
+    for (int i = 0; i < world->n_vertices && incremental; i++) {
+        const struct vertex *v = &world->vertices[i];
+        for (int k = 0; k < v->n_walls && incremental; k++) {
+            const struct wall *wall = v->walls[k];
+            const struct wall *reloaded = sectors[wall->sector]->walls[wall_index(world->sectors[wall->sector], wall)];
+            const struct vec2 *pos = v->endpoints[k] == wall->start ? reloaded->start : reloaded->end;
+            if (k == 0) {
+                moved[i] = *pos;
+            } else {
+                incremental = pos->x == moved[i].x && pos->y == moved[i].y;
+            }
+        }
+    }
+
+    if (!incremental) {
+        // the shape of the map has changed: rebuild everything derived from it
+        #ifdef DEBUG
+        printf("rebuilding world for a map of %d sectors\n", n_sectors);
+        #endif
+        destroy_derived(world);
+        destroy_sectors(world->sectors, world->n_sectors);
+        for (int i = 0; i < world->n_lights; i++) {
+            world->lights[i]->dirty = false;
+        }
+        world->sectors = sectors;
+        world->n_sectors = n_sectors;
+        build_world(world);
+        free(moved);
+        return;
+    }
+
+    for (int i = 0; i < world->n_vertices; i++) {
+        if (moved[i].x != world->vertices[i].pos.x || moved[i].y != world->vertices[i].pos.y) {
+            move_vertex(world, i, &moved[i]);
+        }
+    }
+    // moved vertices and new heights damage the sectors they change, and new colours and
+    // textures only damage the sectors drawn in them
+    for (int i = 1; i < n_sectors + 1; i++) {
+        struct sector *sector = world->sectors[i];
+        if (sectors[i]->floor_z != sector->floor_z || sectors[i]->ceil_z != sector->ceil_z) {
+            set_sector_heights(world, i, sectors[i]->floor_z, sectors[i]->ceil_z);
+        }
+        bool repainted = !same_colour(sectors[i]->floor_colour, sector->floor_colour)
+            || !same_colour(sectors[i]->ceil_colour, sector->ceil_colour)
+            || sectors[i]->floor_texture != sector->floor_texture
+            || sectors[i]->ceil_texture != sector->ceil_texture;
+        for (int j = 0; j < sector->n_walls; j++) {
+            repainted |= sectors[i]->walls[j]->texture_id != sector->walls[j]->texture_id;
+        }
+        if (repainted) {
+            damage_sector(world, i);
+        }
+        *sector->floor_colour = *sectors[i]->floor_colour;
+        *sector->ceil_colour = *sectors[i]->ceil_colour;
+        sector->floor_texture = sectors[i]->floor_texture;
+        sector->ceil_texture = sectors[i]->ceil_texture;
+        for (int j = 0; j < sector->n_walls; j++) {
+            sector->walls[j]->texture_id = sectors[i]->walls[j]->texture_id;
+        }
+    }
+    free(world->texture_starts);
+    free(world->texture_sectors);
+    build_texture_index(world);
+    destroy_sectors(sectors, n_sectors);
+    free(moved);
+}
+
+void reload_lights(struct world *world, struct light **lights, const int n_lights) {
+    damage_world(world);
+    if (n_lights == world->n_lights) {
+        for (int i = 0; i < n_lights; i++) {
+            struct light *light = world->lights[i];
+            if (lights[i]->pos->x != light->pos->x || lights[i]->pos->y != light->pos->y) {
+                move_light(world, i, lights[i]->pos);
+            }
+            light->intensity = lights[i]->intensity;
+        }
+        destroy_lights(lights, n_lights);
+        return;
+    }
+
+    // lights were added or removed, so the ids have changed. Every light is queued, so every
+    // span is cleared and traced again
+    destroy_lights(world->lights, world->n_lights);
+    world->lights = lights;
+    world->n_lights = n_lights;
+    world->changes->n_lights = 0;
+    world->changes->lights = realloc(world->changes->lights, max(n_lights, 1) * sizeof(int));
+    for (int i = 0; i < n_lights; i++) {
+        queue_light(world, i);
+    }
+}
+
+void reload_entities(struct world *world, struct entity *entities, const int n_entities) {
+    damage_world(world);
+    for (int i = 0; i < world->n_entities; i++) {
+        if (world->entities[i].sector != 0) {
+            world->sectors[world->entities[i].sector]->n_entities = 0;
+        }
+    }
+    free(world->entities);
+    world->entities = entities;
+    world->n_entities = n_entities;
+    for (int i = 0; i < n_entities; i++) {
+        entities[i].sector = find_sector(world, &entities[i].pos);
+        add_to_sector(world, i);
+    }
+}
+
+void update_world(struct world *world) {
+    struct changes *changes = world->changes;
+
+    // walls with moved endpoints are rebuilt in full. A light only meets the walls of the sectors
+    // it is traced into, so the lights traced into the sectors of the moved walls are traced
+    // again. The walls of a vertex all move with it, so these include the lights that reach a
+    // moved portal from the other side. A light outside the map lights any wall it is in front of
+    if (changes->n_walls > 0) {
+        for (int i = 0; i < changes->n_walls; i++) {
+            struct sector *sector = world->sectors[changes->walls[i]->sector];
+            rebuild_geometry(changes->walls[i]);
+            rebuild_outline(sector);
+            for (int j = 0; j < sector->n_lights; j++) {
+                queue_light(world, sector->lights[j]);
+            }
+        }
+        for (int i = 0; i < world->n_lights; i++) {
+            if (world->lights[i]->sector == 0) {
+                queue_light(world, i);
+            }
+        }
+    }
+
+    // a changed light is traced again, damaging the parts of walls it reaches before and after.
+    // The spans of a wall are in order of light, so the lights are removed from the last and
+    // traced again from the first, which adds the spans of each after those already traced. In an
+    // open map a moved wall is seen by every light, and then every span is cleared at once
+    if (changes->n_lights > 0 && changes->n_lights == world->n_lights) {
+        trace_lights(world);
+    } else {
+        qsort(changes->lights, changes->n_lights, sizeof(int), compare_lights);
+        for (int i = changes->n_lights - 1; i >= 0; i--) {
+            remove_lit_spans(world, changes->lights[i]);
+        }
+        for (int i = 0; i < changes->n_lights; i++) {
+            trace_light(world, changes->lights[i]);
+        }
+    }
+    for (int i = 0; i < changes->n_lights; i++) {
+        world->lights[changes->lights[i]]->dirty = false;
+    }
+
+    // new heights change the steps through the portals in and out of the sector
+    for (int i = 0; i < changes->n_sectors; i++) {
+        struct sector *sector = world->sectors[changes->sectors[i]];
+        for (int j = 0; j < sector->n_walls; j++) {
+            rebuild_passable(world, sector->walls[j]);
+        }
+        for (int j = 0; j < sector->n_entries; j++) {
+            rebuild_passable(world, sector->entries[j]);
+        }
+        sector->dirty = false;
+    }
+
+    for (int i = 0; i < changes->n_walls; i++) {
+        changes->walls[i]->dirty = false;
+    }
+    #ifdef DEBUG
+    if (changes->n_sectors + changes->n_walls + changes->n_lights > 0) {
+        printf("updated %d sectors, %d walls and %d lights\n", changes->n_sectors, changes->n_walls, changes->n_lights);
+    }
+    #endif
+    changes->n_sectors = 0;
+    changes->n_walls = 0;
+    changes->n_lights = 0;
+}
+
+void destroy_world(struct world *world) {
+    destroy_derived(world);
+    destroy_sectors(world->sectors, world->n_sectors);
+    destroy_textures(world->textures, world->n_textures);
+    destroy_lights(world->lights, world->n_lights);
+    free(world->entities);
+}
@@ -0,0 +1,754 @@
+#include "engine.h"
+#include "agents.h"
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define GOLDEN_WIDTH 320  // the width of the frames compared
+#define GOLDEN_HEIGHT 240  // the height of the frames compared
+#define GOLDEN_THREADS 4  // the number of threads used by the threaded paths
+#define GOLDEN_AGENTS 256  // the number of agents started in each sector by the agent check
+#define GOLDEN_TICKS 2000  // the number of ticks the agent check moves the agents for
+#define GOLDEN_TURN 97  // the number of ticks between the agents of the agent check turning
+#define GOLDEN_ANGLE 2.3999632f  // the golden angle in radians, which the agents are spread and turned by
+
+/**
+ * A fixed camera pose.
+ *
+ * @param x: The x coordinate of the camera.
+ * @param y: The y coordinate of the camera.
+ * @param angle: The camera angle in radians.
+ * @param sector: The sector the camera is in.
+ * @param manifest_path: The asset manifest of the level the pose is in, or NULL for the level
+ *                       given on the command line.
+ */
+struct pose {
+    float x, y, angle;
+    int sector;
+    const char *manifest_path;
+};
+
+/**
+ * A set of render options that frames are compared under.
+ *
+ * @param name: The name of the configuration.
+ * @param output: The output style.
+ * @param lighting: The lighting model.
+ * @param max_portal_depth: The maximum number of portals traversed per column.
+ * @param max_distance: The view distance, or 0 for no limit.
+ * @param fog: Whether the distance fog is used.
+ * @param mipmaps: Whether walls are mipmapped.
+ * @param texture_budget: The texture budget in bytes, or 0 to keep every texture resident.
+ */
+struct config {
+    const char *name;
+    enum output_mode output;
+    enum lighting_mode lighting;
+    int max_portal_depth;
+    double max_distance;
+    bool fog;
+    bool mipmaps;
+    size_t texture_budget;
+};
+
+/**
+ * A way of rendering every pose with an engine, filling in one 8-bit RGB image per pose.
+ */
+typedef void (*path_fn)(struct engine *engine, const struct camera *cameras, struct framebuffer *fbs, const int n_poses);
+
+/**
+ * An alternate render path, compared pixel by pixel against the reference path.
+ *
+ * @param name: The name of the path.
+ * @param fn: Renders the poses.
+ * @param n_threads: The number of threads of the engine used by the path.
+ * @param tolerance: The largest difference allowed in any channel of any pixel, out of 255. Exact
+ *                   paths have a tolerance of 0.
+ * @param shift: The number of pixels that edges may move by. A pixel matches if it is within the
+ *               tolerance of any pixel of the reference this close to it. Exact paths have 0.
+ * @param max_bad: The fraction of the pixels of a frame allowed to differ by more than the
+ *                 tolerance. Exact paths allow none.
+ */
+struct path {
+    const char *name;
+    path_fn fn;
+    int n_threads;
+    int tolerance;
+    int shift;
+    float max_bad;
+};
+
+// the poses rendered on the bundled church level, and on the small level of map.txt. Each
+// configuration but the budget one changes every pose, except that the first sees no further
+// than the shallow portal depth
+static const struct pose poses[] = {
+    {2.0, 2.0, 3.14156, 1, NULL},
+    {3.0, 9.0, 1.2, 2, NULL},
+    {7.0, 6.5, 0.3, 3, NULL},
+    {2.5, 1.5, 4.0, 1, NULL},
+    {3.0, 1.5, 4.712, 1, NULL},
+    {3.5, 13.5, 1.5708, 2, NULL},
+    {6.5, 8.5, 3.2416, 7, NULL},
+    {1.5, 2.0, 4.027, 1, "./content/mapmanifest.txt"}
+};
+#define N_POSES ((int) (sizeof(poses) / sizeof(poses[0])))
+
+// the textures of the budget configuration are streamed in by the texture cache, which must then
+// draw the same frames as the colour configuration. The budget holds every texture of the levels,
+// so that no texture a pose sees is evicted by the poses before it
+static const struct config configs[] = {
+    {"dither", OUTPUT_DITHER, LIGHTING_LAMBERTIAN, MAX_PORTAL_DEPTH, 0.0, false, true, 0},
+    {"colour", OUTPUT_COLOUR, LIGHTING_LAMBERTIAN, MAX_PORTAL_DEPTH, 0.0, false, true, 0},
+    {"indexed", OUTPUT_INDEXED, LIGHTING_LAMBERTIAN, MAX_PORTAL_DEPTH, 0.0, false, true, 0},
+    {"fullbright", OUTPUT_COLOUR, LIGHTING_FULLBRIGHT, MAX_PORTAL_DEPTH, 0.0, false, true, 0},
+    {"fog", OUTPUT_COLOUR, LIGHTING_LAMBERTIAN, MAX_PORTAL_DEPTH, 6.0, true, true, 0},
+    {"shallow", OUTPUT_DITHER, LIGHTING_LAMBERTIAN, 1, 0.0, false, true, 0},
+    {"unfiltered", OUTPUT_COLOUR, LIGHTING_LAMBERTIAN, MAX_PORTAL_DEPTH, 0.0, false, false, 0},
+    {"budget", OUTPUT_COLOUR, LIGHTING_LAMBERTIAN, MAX_PORTAL_DEPTH, 0.0, false, true, 16 << 20}
+};
+#define N_CONFIGS ((int) (sizeof(configs) / sizeof(configs[0])))
+
+/**
+ * Render each pose on its own with render_frame().
+ */
+static void render_frames(struct engine *engine, const struct camera *cameras, struct framebuffer *fbs, const int n_poses) {
+    for (int i = 0; i < n_poses; i++) {
+        render_frame(engine, &cameras[i], &fbs[i]);
+    }
+}
+
+/**
+ * Render every pose at once with render_batch().
+ */
+static void render_batched(struct engine *engine, const struct camera *cameras, struct framebuffer *fbs, const int n_poses) {
+    render_batch(engine, cameras, fbs, n_poses);
+}
+
+/**
+ * Render each pose on its own with render_frame() in fixed point.
+ */
+static void render_fixed_point(struct engine *engine, const struct camera *cameras, struct framebuffer *fbs, const int n_poses) {
+    engine->options.fixed_point = true;
+    render_frames(engine, cameras, fbs, n_poses);
+}
+
+/**
+ * Reload the lights as a hot reload of the lights file does, keeping the first `n_kept` lights of
+ * the world and adding a light at the given position, or none if it is NULL.
+ */
+static void reload_kept_lights(struct world *world, const int n_kept, const struct vec2 *added) {
+    int n_lights = n_kept + (added != NULL);
+    struct light **lights = malloc(n_lights * sizeof(struct light *));
+    for (int i = 0; i < n_lights; i++) {
+        struct light *light = calloc(1, sizeof(struct light));
+        light->pos = malloc(sizeof(struct vec2));
+        *light->pos = i < n_kept ? *world->lights[i]->pos : *added;
+        light->intensity = i < n_kept ? world->lights[i]->intensity : 0.5f;
+        lights[i] = light;
+    }
+    reload_lights(world, lights, n_lights);
+}
+
+/**
+ * Change the world in front of a pose, render the pose, then undo the change and render it again.
+ * The second frame only renders the columns the change damaged, so any column that should have
+ * been damaged but was not still shows the change.
+ */
+static void render_undo(struct engine *engine, const struct camera *camera, struct framebuffer *fb, const int change) {
+    struct world *world = &engine->world;
+    struct light *light = world->lights[0];
+    const struct sector *sector = world->sectors[camera->sector];
+    const struct wall *door = NULL;
+    for (int i = 0; i < sector->n_walls && door == NULL; i++) {
+        door = sector->walls[i]->portal != 0 ? sector->walls[i] : NULL;
+    }
+    int next = door->portal;
+    int vertex = find_vertex(world, door->start);
+    struct vec2 vertex_pos = *door->start;
+    struct vec2 light_pos = *light->pos, entity_pos = {0.0f, 0.0f};
+    int entity_sector = 0;
+    if (world->n_entities > 0) {
+        entity_pos = world->entities[0].pos;
+        entity_sector = world->entities[0].sector;
+    }
+    float floor_z = world->sectors[next]->floor_z, ceil_z = world->sectors[next]->ceil_z;
+    texture wall_texture = world->textures[sector->walls[0]->texture_id];
+    struct rgb *texels = wall_texture->texels;
+
+    // the camera looks along -(cos, sin)
+    struct vec2 ahead = {camera->pos->x - 1.5f * camera->anglecos, camera->pos->y - 1.5f * camera->anglesin};
+    switch (change) {
+        case 0:
+            move_light(world, 0, &ahead);
+            break;
+        case 1:
+            set_light_intensity(world, 0, 0.5f * light->intensity);
+            break;
+        case 2:
+            // a level without entities is rendered unchanged
+            if (world->n_entities > 0) {
+                move_entity(world, 0, &ahead, find_sector(world, &ahead));
+            }
+            break;
+        case 3:
+            // drawn in its fallback colour everywhere, as if the texture cache had evicted it, so
+            // that only the damage done when it comes back redraws it
+            wall_texture->texels = NULL;
+            damage_world(world);
+            break;
+        case 4: {
+            // slide the start of the portal a fifth of the way along it, which narrows it
+            struct vec2 narrowed = {
+                vertex_pos.x + 0.2f * (door->end->x - vertex_pos.x), vertex_pos.y + 0.2f * (door->end->y - vertex_pos.y)
+            };
+            move_vertex(world, vertex, &narrowed);
+            break;
+        }
+        case 5:
+            // a light added to the lights file, which traces every light again
+            reload_kept_lights(world, world->n_lights, &ahead);
+            break;
+        default:
+            set_sector_heights(world, next, floor_z + 0.3f, ceil_z - 0.3f);
+            break;
+    }
+    update_world(world);
+    render_frame(engine, camera, fb);
+
+    switch (change) {
+        case 0:
+            move_light(world, 0, &light_pos);
+            break;
+        case 1:
+            set_light_intensity(world, 0, 2.0f * light->intensity);
+            break;
+        case 2:
+            if (world->n_entities > 0) {
+                move_entity(world, 0, &entity_pos, entity_sector);
+            }
+            break;
+        case 3:
+            wall_texture->texels = texels;
+            damage_texture(world, sector->walls[0]->texture_id);
+            break;
+        case 4:
+            move_vertex(world, vertex, &vertex_pos);
+            break;
+        case 5:
+            reload_kept_lights(world, world->n_lights - 1, NULL);
+            break;
+        default:
+            set_sector_heights(world, next, floor_z, ceil_z);
+            break;
+    }
+    update_world(world);
+    render_frame(engine, camera, fb);
+}
+
+/**
+ * Render each pose after undoing each kind of change to the world in turn, then once more with
+ * nothing changed, which reuses the whole frame.
+ */
+static void render_incremental(struct engine *engine, const struct camera *cameras, struct framebuffer *fbs, const int n_poses) {
+    for (int i = 0; i < n_poses; i++) {
+        for (int change = 0; change < 7; change++) {
+            render_undo(engine, &cameras[i], &fbs[i], change);
+        }
+        render_frame(engine, &cameras[i], &fbs[i]);
+    }
+}
+
+// the reference path: every frame rendered on a single thread
+static const struct path reference = {"reference", render_frames, 1, 0, 0, 0.0f};
+
+// the alternate paths, which must match the reference path within their tolerance. The fixed
+// point path rounds depths differently, which moves edges and texture rows by a pixel when a
+// projection lands close to a whole row. On a wall close to the camera, as in pose 5, that moves
+// every texel boundary, so edges may move by a pixel. The fog fades a flat by the depth of the
+// wall behind it, and a flat whose faded colour lands halfway between two levels rounds to either,
+// so colours may differ by one level. Where a texture is minified, on distant floors and walls
+// seen at a grazing angle, neighbouring pixels sample texels far apart and the other rounding
+// picks another texel outright. That is at most 2.5% of the pixels of a pose here, so 3% may differ
+static const struct path paths[] = {
+    {"threaded", render_frames, GOLDEN_THREADS, 0, 0, 0.0f},
+    {"batch", render_batched, GOLDEN_THREADS, 0, 0, 0.0f},
+    {"incremental", render_incremental, GOLDEN_THREADS, 0, 0, 0.0f},
+    {"fixed", render_fixed_point, GOLDEN_THREADS, 1, 1, 0.03f}
+};
+#define N_PATHS ((int) (sizeof(paths) / sizeof(paths[0])))
+
+/**
+ * Return the 64-bit FNV-1a hash of the given bytes.
+ */
+static uint64_t checksum(const unsigned char *data, const size_t n_bytes) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < n_bytes; i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * Render frames until the texture cache has every texture the poses see. The background thread is
+ * waited on after each frame, so the frames rendered next do not depend on how quickly it loads.
+ */
+static void settle_textures(struct engine *engine, const struct camera *cameras, const int n_poses) {
+    struct texture_cache *cache = engine->textures;
+    struct framebuffer *fbs = malloc(n_poses * sizeof(struct framebuffer));
+    for (int i = 0; i < n_poses; i++) {
+        fbs[i].width = GOLDEN_WIDTH;
+        fbs[i].height = GOLDEN_HEIGHT;
+        fbs[i].pixels = calloc(GOLDEN_WIDTH * GOLDEN_HEIGHT * 3, sizeof(float));
+        fbs[i].indices = engine->palette != NULL ? calloc(GOLDEN_WIDTH * GOLDEN_HEIGHT, 1) : NULL;
+    }
+
+    int n_loading;
+    do {
+        render_batch(engine, cameras, fbs, n_poses);
+        n_loading = 0;
+        for (int i = 0; i < cache->n_textures; i++) {
+            n_loading += cache->state[i] == TEXTURE_LOADING;
+        }
+        bool loaded = false;
+        while (!loaded) {
+            pthread_mutex_lock(&cache->lock);
+            loaded = cache->n_loaded == n_loading;
+            pthread_mutex_unlock(&cache->lock);
+            if (!loaded) {
+                usleep(1000);
+            }
+        }
+    } while (n_loading > 0);
+
+    for (int i = 0; i < n_poses; i++) {
+        free(fbs[i].pixels);
+        free(fbs[i].indices);
+    }
+    free(fbs);
+}
+
+/**
+ * Render a run of poses of one level through a path, as 8-bit RGB images stored row by row from
+ * the top of the image.
+ *
+ * @param manifest_path: The filepath of the asset manifest of the level.
+ * @param options: The render options.
+ * @param path: The render path.
+ * @param first: The index of the first pose.
+ * @param n_poses: The number of poses.
+ * @param images: Filled in with one image per pose, from index `first`.
+ * @return Whether the level was loaded.
+ */
+static bool render_level(
+    const char *manifest_path,
+    const struct render_options *options,
+    const struct path *path,
+    const int first,
+    const int n_poses,
+    unsigned char **images
+) {
+    struct engine *engine = create_engine(manifest_path, options, path->n_threads);
+    if (engine == NULL) {
+        return false;
+    }
+
+    struct camera cameras[N_POSES];
+    struct vec2 positions[N_POSES];
+    struct framebuffer fbs[N_POSES];
+    for (int i = 0; i < n_poses; i++) {
+        const struct pose *pose = &poses[first + i];
+        positions[i] = (struct vec2) {pose->x, pose->y};
+        place_camera(engine, &cameras[i], &positions[i], pose->angle, pose->sector);
+        fbs[i].width = GOLDEN_WIDTH;
+        fbs[i].height = GOLDEN_HEIGHT;
+        fbs[i].pixels = calloc(GOLDEN_WIDTH * GOLDEN_HEIGHT * 3, sizeof(float));
+        fbs[i].indices = engine->palette != NULL ? calloc(GOLDEN_WIDTH * GOLDEN_HEIGHT, 1) : NULL;
+    }
+    if (engine->textures != NULL) {
+        settle_textures(engine, cameras, n_poses);
+    }
+
+    path->fn(engine, cameras, fbs, n_poses);
+
+    for (int i = 0; i < n_poses; i++) {
+        if (engine->palette != NULL) {
+            expand_indices(engine->palette, fbs[i].indices, fbs[i].pixels, GOLDEN_WIDTH * GOLDEN_HEIGHT);
+        }
+        // the framebuffer is stored from the bottom of the screen
+        unsigned char *image = malloc(GOLDEN_WIDTH * GOLDEN_HEIGHT * 3);
+        for (int y = 0; y < GOLDEN_HEIGHT; y++) {
+            const float *row = &fbs[i].pixels[3 * (GOLDEN_HEIGHT - 1 - y) * GOLDEN_WIDTH];
+            for (int x = 0; x < 3 * GOLDEN_WIDTH; x++) {
+                image[3 * y * GOLDEN_WIDTH + x] = (unsigned char) (min(max(row[x], 0.0f), 1.0f) * 255.0f + 0.5f);
+            }
+        }
+        images[first + i] = image;
+        free(fbs[i].pixels);
+        free(fbs[i].indices);
+    }
+    destroy_engine(engine);
+    return true;
+}
+
+/**
+ * Return whether two poses are in the same level, given their manifest paths.
+ */
+static bool same_level(const char *a, const char *b) {
+    return a == NULL || b == NULL ? a == b : strcmp(a, b) == 0;
+}
+
+/**
+ * Render every pose through a path under a configuration, with one context per level.
+ *
+ * @param manifest_path: The filepath of the asset manifest of the poses without their own.
+ * @param config: The configuration.
+ * @param path: The render path.
+ * @param images: Filled in with one image per pose.
+ * @return Whether every level was loaded.
+ */
+static bool render_poses(const char *manifest_path, const struct config *config, const struct path *path, unsigned char **images) {
+    struct render_options options;
+    default_render_options(&options);
+    options.output = config->output;
+    options.lighting = config->lighting;
+    options.max_portal_depth = config->max_portal_depth;
+    options.mipmaps = config->mipmaps;
+    options.texture_budget = config->texture_budget;
+    if (config->max_distance > 0.0) {
+        options.max_distance = config->max_distance;
+        options.fog = config->fog;
+        options.fog_start = FOG_START * options.max_distance;
+    }
+
+    // the poses of a level are listed together
+    int first = 0;
+    while (first < N_POSES) {
+        const char *level = poses[first].manifest_path;
+        int n_poses = 1;
+        while (first + n_poses < N_POSES && same_level(poses[first + n_poses].manifest_path, level)) {
+            n_poses++;
+        }
+        if (!render_level(level != NULL ? level : manifest_path, &options, path, first, n_poses, images)) {
+            return false;
+        }
+        first += n_poses;
+    }
+    return true;
+}
+
+/**
+ * Write an 8-bit RGB image to a PPM file.
+ */
+static bool write_image(const char *filepath, const unsigned char *image) {
+    FILE *file;
+    if ((file = fopen(filepath, "wb")) == NULL) {
+        perror("write_image");
+        return false;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", GOLDEN_WIDTH, GOLDEN_HEIGHT);
+    fwrite(image, 1, GOLDEN_WIDTH * GOLDEN_HEIGHT * 3, file);
+    fclose(file);
+    return true;
+}
+
+/**
+ * Read an 8-bit RGB image from a PPM file written by write_image().
+ *
+ * @return A pointer to a heap allocated image, or NULL if there is no image of the right size.
+ */
+static unsigned char *read_image(const char *filepath) {
+    FILE *file;
+    if ((file = fopen(filepath, "rb")) == NULL) {
+        return NULL;
+    }
+    int width, height, max_colour;
+    unsigned char *image = NULL;
+    if (fscanf(file, "P6\n%d %d\n%d", &width, &height, &max_colour) == 3
+    && width == GOLDEN_WIDTH && height == GOLDEN_HEIGHT && max_colour == 255) {
+        fseek(file, 1, SEEK_CUR);
+        image = malloc(GOLDEN_WIDTH * GOLDEN_HEIGHT * 3);
+        if (fread(image, 1, GOLDEN_WIDTH * GOLDEN_HEIGHT * 3, file) != GOLDEN_WIDTH * GOLDEN_HEIGHT * 3) {
+            free(image);
+            image = NULL;
+        }
+    }
+    fclose(file);
+    return image;
+}
+
+/**
+ * Compare an image against the expected image pixel by pixel. If more pixels than allowed differ
+ * by more than the tolerance, write a diff image: the expected image dimmed to grey, with the
+ * differing pixels in red, brighter the larger the difference.
+ *
+ * @param expected: The expected image.
+ * @param actual: The image being checked.
+ * @param tolerance: The largest difference allowed in any channel, out of 255.
+ * @param shift: The number of pixels that edges may move by.
+ * @param max_bad: The number of pixels allowed to differ by more than the tolerance.
+ * @param diff_path: The filepath the diff image is written to.
+ * @param max_error: Set to the largest difference in any channel.
+ * @return The number of pixels that differ by more than the tolerance.
+ */
+static int compare_images(
+    const unsigned char *expected,
+    const unsigned char *actual,
+    const int tolerance,
+    const int shift,
+    const int max_bad,
+    const char *diff_path,
+    int *max_error
+) {
+    int n_bad = 0;
+    *max_error = 0;
+    unsigned char *diff = malloc(GOLDEN_WIDTH * GOLDEN_HEIGHT * 3);
+    for (int i = 0; i < GOLDEN_WIDTH * GOLDEN_HEIGHT; i++) {
+        // the error is to the closest of the expected pixels the edges may have moved from
+        int x = i % GOLDEN_WIDTH, y = i / GOLDEN_WIDTH, error = 255;
+        for (int ny = max(y - shift, 0); ny <= min(y + shift, GOLDEN_HEIGHT - 1); ny++) {
+            for (int nx = max(x - shift, 0); nx <= min(x + shift, GOLDEN_WIDTH - 1); nx++) {
+                int j = ny * GOLDEN_WIDTH + nx, near = 0;
+                for (int c = 0; c < 3; c++) {
+                    near = max(near, abs(expected[3 * j + c] - actual[3 * i + c]));
+                }
+                error = min(error, near);
+            }
+        }
+        *max_error = max(*max_error, error);
+
+        unsigned char grey = (expected[3 * i] + expected[3 * i + 1] + expected[3 * i + 2]) / 12;
+        if (error > tolerance) {
+            n_bad++;
+            diff[3 * i + 0] = 128 + error / 2;
+            diff[3 * i + 1] = 0;
+            diff[3 * i + 2] = 0;
+        } else {
+            diff[3 * i + 0] = grey;
+            diff[3 * i + 1] = grey;
+            diff[3 * i + 2] = grey;
+        }
+    }
+    if (n_bad > max_bad) {
+        write_image(diff_path, diff);
+    }
+    free(diff);
+    return n_bad;
+}
+
+/**
+ * Walk agents around the level on the thread pool, starting GOLDEN_AGENTS in the middle of each
+ * sector heading every way and turning them every GOLDEN_TURN ticks, and check that after every
+ * tick each agent is inside the sector it is recorded in, to within WALL_MARGIN of its walls.
+ *
+ * @param manifest_path: The filepath of the asset manifest.
+ * @param n_ticks: Set to the number of ticks checked.
+ * @return The number of ticks after which an agent was outside its sector, or -1 if the level
+ *         could not be loaded.
+ */
+static int check_agents(const char *manifest_path, int *n_ticks) {
+    struct render_options options;
+    default_render_options(&options);
+    struct engine *engine = create_engine(manifest_path, &options, GOLDEN_THREADS);
+    if (engine == NULL) {
+        return -1;
+    }
+    const struct world *world = &engine->world;
+
+    struct agents agents;
+    agents.n_agents = GOLDEN_AGENTS * world->n_sectors;
+    agents.x = malloc(agents.n_agents * sizeof(float));
+    agents.y = malloc(agents.n_agents * sizeof(float));
+    agents.vx = malloc(agents.n_agents * sizeof(float));
+    agents.vy = malloc(agents.n_agents * sizeof(float));
+    agents.sector = malloc(agents.n_agents * sizeof(int));
+    for (int i = 0; i < agents.n_agents; i++) {
+        const struct sector *sector = world->sectors[1 + i / GOLDEN_AGENTS];
+        float x = 0.0f, y = 0.0f;
+        for (int j = 0; j < sector->n_walls; j++) {
+            x += sector->walls[j]->start->x;
+            y += sector->walls[j]->start->y;
+        }
+        // the golden angle apart, so that no two agents head the same way
+        float angle = GOLDEN_ANGLE * i, speed = 1.0f + 0.25f * (i % 9);
+        agents.x[i] = x / sector->n_walls;
+        agents.y[i] = y / sector->n_walls;
+        agents.vx[i] = speed * cosf(angle);
+        agents.vy[i] = speed * sinf(angle);
+        agents.sector[i] = sector->id;
+    }
+
+    int n_failed = 0;
+    for (int tick = 0; tick < GOLDEN_TICKS; tick++) {
+        move_agents(world, engine->pool, &agents, 1.0f / 60.0f);
+        int outside = -1;
+        for (int i = 0; i < agents.n_agents; i++) {
+            const struct sector *sector = world->sectors[agents.sector[i]];
+            for (int j = 0; j < sector->n_walls && agents.sector[i] != 0; j++) {
+                const struct wall *wall = sector->walls[j];
+                float dir_x = wall->end->x - wall->start->x, dir_y = wall->end->y - wall->start->y;
+                float side = (agents.x[i] - wall->start->x) * dir_y - (agents.y[i] - wall->start->y) * dir_x;
+                if (side < -(float) WALL_MARGIN * wall->length) {
+                    outside = i;
+                }
+            }
+
+            // turned by the golden angle, so that each agent heads every way in turn
+            if (tick % GOLDEN_TURN == GOLDEN_TURN - 1) {
+                float vx = agents.vx[i];
+                agents.vx[i] = vx * cosf(GOLDEN_ANGLE) - agents.vy[i] * sinf(GOLDEN_ANGLE);
+                agents.vy[i] = vx * sinf(GOLDEN_ANGLE) + agents.vy[i] * cosf(GOLDEN_ANGLE);
+            }
+        }
+        (*n_ticks)++;
+        if (outside >= 0) {
+            n_failed++;
+            printf("FAIL agents tick %d: agent %d at (%g, %g) is outside sector %d\n",
+                tick, outside, agents.x[outside], agents.y[outside], agents.sector[outside]);
+        }
+    }
+
+    free(agents.x);
+    free(agents.y);
+    free(agents.vx);
+    free(agents.vy);
+    free(agents.sector);
+    destroy_engine(engine);
+    return n_failed;
+}
+
+/**
+ * Return the checksum recorded for a frame, or 0 if none was recorded.
+ */
+static uint64_t recorded_checksum(FILE *file, const char *config, const int pose) {
+    char name[64];
+    int p;
+    unsigned long long hash;
+    rewind(file);
+    while (fscanf(file, "%63s %d %llx", name, &p, &hash) == 3) {
+        if (strcmp(name, config) == 0 && p == pose) {
+            return hash;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *manifest_path = "./content/manifest.txt";
+    const char *checksum_path = "./tools/golden.txt";
+    const char *out_dir = "./build/frames";
+    bool record = false;
+    int tolerance = -1, opt;
+    while ((opt = getopt(argc, argv, "rm:c:o:t:")) != -1) {
+        switch (opt) {
+            case 'r':
+                record = true;
+                break;
+            case 'm':
+                manifest_path = optarg;
+                break;
+            case 'c':
+                checksum_path = optarg;
+                break;
+            case 'o':
+                out_dir = optarg;
+                break;
+            case 't':
+                tolerance = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-r] [-m MANIFEST] [-c CHECKSUMS] [-o OUTPUT_DIR] [-t TOLERANCE]\n", argv[0]);
+                exit(1);
+        }
+    }
+    mkdir("./build", 0755);
+    mkdir(out_dir, 0755);
+
+    FILE *checksums = fopen(checksum_path, record ? "w" : "r");
+    if (checksums == NULL) {
+        perror(checksum_path);
+        exit(1);
+    }
+
+    char filepath[MAX_PATH_LEN * 2];
+    int n_failed = 0, n_checked = 0;
+    for (int c = 0; c < N_CONFIGS; c++) {
+        const struct config *config = &configs[c];
+        unsigned char *expected[N_POSES];
+        if (!render_poses(manifest_path, config, &reference, expected)) {
+            fprintf(stderr, "Error loading %s\n", manifest_path);
+            exit(1);
+        }
+
+        // the reference path is checked against the recorded checksums and images
+        for (int i = 0; i < N_POSES; i++) {
+            uint64_t hash = checksum(expected[i], GOLDEN_WIDTH * GOLDEN_HEIGHT * 3);
+            snprintf(filepath, sizeof(filepath), "%s/%s_%d.ppm", out_dir, config->name, i);
+            if (record) {
+                fprintf(checksums, "%s %d %016llx\n", config->name, i, (unsigned long long) hash);
+                write_image(filepath, expected[i]);
+                continue;
+            }
+
+            n_checked++;
+            uint64_t recorded = recorded_checksum(checksums, config->name, i);
+            if (hash == recorded) {
+                continue;
+            }
+            n_failed++;
+            printf("FAIL %s pose %d reference: checksum %016llx, recorded %016llx", config->name, i,
+                (unsigned long long) hash, (unsigned long long) recorded);
+            unsigned char *golden = read_image(filepath);
+            if (golden != NULL) {
+                int max_error;
+                snprintf(filepath, sizeof(filepath), "%s/%s_%d_reference_diff.ppm", out_dir, config->name, i);
+                int n_bad = compare_images(golden, expected[i], 0, 0, 0, filepath, &max_error);
+                printf(", %d pixels differ, max error %d, see %s", n_bad, max_error, filepath);
+                free(golden);
+            } else {
+                // the reference images are local to the build, so a fresh checkout has none
+                printf(", no reference image to compare with, record one with -r on a known good tree");
+            }
+            printf("\n");
+        }
+
+        // every alternate path is checked against the reference path
+        for (int p = 0; p < N_PATHS && !record; p++) {
+            const struct path *path = &paths[p];
+            unsigned char *actual[N_POSES];
+            render_poses(manifest_path, config, path, actual);
+            int max_bad = (int) (path->max_bad * GOLDEN_WIDTH * GOLDEN_HEIGHT);
+            for (int i = 0; i < N_POSES; i++) {
+                int max_error;
+                snprintf(filepath, sizeof(filepath), "%s/%s_%d_%s_diff.ppm", out_dir, config->name, i, path->name);
+                int n_bad = compare_images(expected[i], actual[i], tolerance >= 0 ? tolerance : path->tolerance, path->shift, max_bad, filepath, &max_error);
+                n_checked++;
+                if (n_bad > max_bad) {
+                    n_failed++;
+                    printf("FAIL %s pose %d %s: %d pixels differ, max error %d, see %s\n",
+                        config->name, i, path->name, n_bad, max_error, filepath);
+                }
+                free(actual[i]);
+            }
+        }
+
+        for (int i = 0; i < N_POSES; i++) {
+            free(expected[i]);
+        }
+    }
+    fclose(checksums);
+
+    if (record) {
+        printf("Recorded %d frames to %s and %s\n", N_CONFIGS * N_POSES, checksum_path, out_dir);
+        return 0;
+    }
+    printf("%d of %d frames match\n", n_checked - n_failed, n_checked);
+
+    int n_ticks = 0, n_ticks_failed = check_agents(manifest_path, &n_ticks);
+    if (n_ticks_failed < 0) {
+        fprintf(stderr, "Error loading %s\n", manifest_path);
+        exit(1);
+    }
+    printf("%d of %d agent ticks keep every agent in its sector\n", n_ticks - n_ticks_failed, n_ticks);
+    return n_failed > 0 || n_ticks_failed > 0;
+}
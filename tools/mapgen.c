@@ -0,0 +1,333 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#define CELL_SIZE 4.0  // the width and depth of every sector, in game units
+#define MAX_SECTORS 1000000  // the largest map generated
+#define N_WALL_TEXTURES 3  // the textures of the church level used for walls
+
+/**
+ * The parameters of a generated map.
+ *
+ * @param name: The name of the preset.
+ * @param n_sectors: The number of sectors.
+ * @param cols: The number of sectors per row of the grid, or 0 for a square grid. Rows longer
+ *              than the map hold every sector.
+ * @param walls: The number of walls per sector, rounded down to a multiple of 4.
+ * @param connectivity: The chance that two neighbouring sectors are joined by a portal beyond the
+ *                      portals that make every sector reachable, from 0 to 1.
+ * @param height_var: The largest floor height. Floors differing by a metre or more cannot be
+ *                    walked between.
+ * @param room_height: The height from the floor to the ceiling of every sector.
+ * @param n_lights: The number of lights.
+ */
+struct params {
+    const char *name;
+    int n_sectors;
+    int cols;
+    int walls;
+    double connectivity;
+    double height_var;
+    double room_height;
+    int n_lights;
+};
+
+// the preset stress scenarios
+static const struct params presets[] = {
+    // a single row of sectors, each open to the next: deep portal chains along one axis
+    {"corridor", 10000, MAX_SECTORS, 4, 0.0, 0.3, 3.0, 100},
+    // a square grid of rooms and streets with varied floors and some portals walled off
+    {"city", 100000, 0, 8, 0.5, 2.0, 4.0, 1000},
+    // a square grid of high-ceilinged bays open on every side, so rays cross many portals
+    {"cathedral", 10000, 0, 16, 1.0, 0.2, 12.0, 200}
+};
+
+/**
+ * Mix the given values into a well distributed 64 bit hash, so that every property of the map is a
+ * function of the seed and the sector or edge it belongs to. Nothing has to be kept in memory, so
+ * maps of any size are written as they are generated.
+ */
+static uint64_t hash(uint64_t seed, uint64_t a, uint64_t b) {
+    uint64_t z = seed ^ (a * 0x9e3779b97f4a7c15ULL) ^ (b * 0xc2b2ae3d27d4eb4fULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Return a uniform random number in [0, 1) derived from the given values.
+ */
+static double uniform(uint64_t seed, uint64_t a, uint64_t b) {
+    return (hash(seed, a, b) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * A grid of rectangular sectors, filled row by row. The last row may be partly filled.
+ */
+struct grid {
+    int rows, cols, n;
+    uint64_t seed;
+    double connectivity;
+};
+
+/**
+ * The edge of a sector chosen to join it to the rest of the map. Each sector chooses the edge
+ * towards its upper or right neighbour, which joins every sector into a spanning tree rooted at
+ * the last sector. Below a partly filled top row, the sectors with nothing above them lead left
+ * instead, towards the sectors that do.
+ */
+enum choice {
+    CHOICE_NONE,
+    CHOICE_UP,
+    CHOICE_RIGHT,
+    CHOICE_LEFT
+};
+
+static bool exists(const struct grid *grid, const int row, const int col) {
+    return row >= 0 && col >= 0 && col < grid->cols && (long) row * grid->cols + col < grid->n;
+}
+
+static enum choice choose(const struct grid *grid, const int row, const int col) {
+    bool up = exists(grid, row + 1, col), right = exists(grid, row, col + 1);
+    if (up && right && exists(grid, row + 1, col + 1)) {
+        return hash(grid->seed, (long) row * grid->cols + col, 0) & 1 ? CHOICE_UP : CHOICE_RIGHT;
+    }
+    if (up) {
+        return CHOICE_UP;
+    }
+    if (row == grid->rows - 1) {
+        return right ? CHOICE_RIGHT : CHOICE_NONE;
+    }
+    return CHOICE_LEFT;
+}
+
+/**
+ * Return whether the sector at (row, col) is joined by a portal to its right neighbour.
+ */
+static bool open_right(const struct grid *grid, const int row, const int col) {
+    if (!exists(grid, row, col) || !exists(grid, row, col + 1)) {
+        return false;
+    }
+    return choose(grid, row, col) == CHOICE_RIGHT
+        || choose(grid, row, col + 1) == CHOICE_LEFT
+        || uniform(grid->seed, (long) row * grid->cols + col, 1) < grid->connectivity;
+}
+
+/**
+ * Return whether the sector at (row, col) is joined by a portal to its upper neighbour.
+ */
+static bool open_up(const struct grid *grid, const int row, const int col) {
+    if (!exists(grid, row, col) || !exists(grid, row + 1, col)) {
+        return false;
+    }
+    return choose(grid, row, col) == CHOICE_UP
+        || uniform(grid->seed, (long) row * grid->cols + col, 2) < grid->connectivity;
+}
+
+/**
+ * Return the coordinate of point i of k along a side running from a to b. The points are always
+ * measured from the lower end, so the two sectors sharing a side, which run along it in opposite
+ * directions, agree on their vertices exactly.
+ */
+static double side_point(const double a, const double b, const int i, const int k) {
+    return a <= b ? a + (b - a) * i / k : b + (a - b) * (k - i) / k;
+}
+
+/**
+ * Write the walls along one side of a sector, from (x0, y0) to (x1, y1), split into `k` collinear
+ * walls.
+ */
+static void write_side(
+    FILE *file,
+    const double x0,
+    const double y0,
+    const double x1,
+    const double y1,
+    const int k,
+    const int portal,
+    const uint64_t seed,
+    const int id
+) {
+    for (int i = 0; i < k; i++) {
+        int j = i + 1;
+        int texture_id = hash(seed, id, 3 + i) % N_WALL_TEXTURES;
+        fprintf(
+            file, "%.9g %.9g %.9g %.9g %d %d\n",
+            side_point(x0, x1, i, k), side_point(y0, y1, i, k),
+            side_point(x0, x1, j, k), side_point(y0, y1, j, k),
+            portal, texture_id
+        );
+    }
+}
+
+/**
+ * Write the map in the format read by `load_sectors()`. Each sector is a rectangle whose walls run
+ * clockwise, so that their normals (dy, -dx) point into the sector.
+ */
+static bool write_map(const char *path, const struct params *params, const uint64_t seed) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+
+    struct grid grid = {0, params->cols, params->n_sectors, seed, params->connectivity};
+    if (grid.cols <= 0) {
+        grid.cols = (int) ceil(sqrt(params->n_sectors));
+    }
+    grid.cols = grid.cols > params->n_sectors ? params->n_sectors : grid.cols;
+    grid.rows = (params->n_sectors + grid.cols - 1) / grid.cols;
+    int k = params->walls / 4 > 0 ? params->walls / 4 : 1;
+
+    fprintf(file, "%d\n", params->n_sectors);
+    for (int id = 1; id < params->n_sectors + 1; id++) {
+        int row = (id - 1) / grid.cols, col = (id - 1) % grid.cols;
+        double floor_z = params->height_var * uniform(seed, id, 4);
+        double shade = 0.05 + 0.05 * uniform(seed, id, 5);
+        fprintf(file, "%d %d %.3f %.3f\n", id, 4 * k, floor_z, floor_z + params->room_height);
+        fprintf(file, "%.6f %.6f %.6f %.6f %.6f %.6f\n", shade, shade * 1.2, shade * 1.2, 0.1, 0.0, 0.0);
+
+        int left = open_right(&grid, row, col - 1) ? id - 1 : 0;
+        int up = open_up(&grid, row, col) ? id + grid.cols : 0;
+        int right = open_right(&grid, row, col) ? id + 1 : 0;
+        int down = open_up(&grid, row - 1, col) ? id - grid.cols : 0;
+        double x0 = col * CELL_SIZE, x1 = (col + 1) * CELL_SIZE;
+        double y0 = row * CELL_SIZE, y1 = (row + 1) * CELL_SIZE;
+        write_side(file, x0, y0, x0, y1, k, left, seed, 4 * id);
+        write_side(file, x0, y1, x1, y1, k, up, seed, 4 * id + 1);
+        write_side(file, x1, y1, x1, y0, k, right, seed, 4 * id + 2);
+        write_side(file, x1, y0, x0, y0, k, down, seed, 4 * id + 3);
+    }
+    fclose(file);
+    return true;
+}
+
+/**
+ * Write the lights in the format read by `load_lights()`, each in a random sector.
+ */
+static bool write_lights(const char *path, const struct params *params, const uint64_t seed) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+
+    int cols = params->cols > 0 ? params->cols : (int) ceil(sqrt(params->n_sectors));
+    cols = cols > params->n_sectors ? params->n_sectors : cols;
+    fprintf(file, "%d\n", params->n_lights);
+    for (int i = 0; i < params->n_lights; i++) {
+        int cell = hash(seed, i, 6) % params->n_sectors;
+        double x = (cell % cols + 0.25 + 0.5 * uniform(seed, i, 7)) * CELL_SIZE;
+        double y = (cell / cols + 0.25 + 0.5 * uniform(seed, i, 8)) * CELL_SIZE;
+        fprintf(file, "%.4f %.4f %.2f\n", x, y, 0.4 + 0.4 * uniform(seed, i, 9));
+    }
+    fclose(file);
+    return true;
+}
+
+/**
+ * Write an asset manifest for the map and lights, using the wall textures of the church level.
+ */
+static bool write_manifest(const char *path, const char *map_path, const char *lights_path, const struct params *params) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+    fprintf(file, "# a generated %s map of %d sectors\n", params->name, params->n_sectors);
+    fprintf(file, "map %s\nlights %s\n", map_path, lights_path);
+    fprintf(file, "texture ./content/textures/wood.ppm\n");
+    fprintf(file, "texture ./content/textures/rocks.ppm\n");
+    fprintf(file, "texture ./content/textures/brick.ppm\n");
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    struct params params = presets[0];
+    const char *prefix = NULL;
+    uint64_t seed = 1;
+    int opt;
+
+    // the preset is applied first, so that the other options override it
+    for (int i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], "-p") == 0) {
+            bool found = false;
+            for (size_t j = 0; j < sizeof(presets) / sizeof(presets[0]); j++) {
+                if (strcmp(argv[i + 1], presets[j].name) == 0) {
+                    params = presets[j];
+                    found = true;
+                }
+            }
+            if (!found) {
+                fprintf(stderr, "Error: unknown preset %s, expected corridor, city or cathedral\n", argv[i + 1]);
+                exit(1);
+            }
+        }
+    }
+    while ((opt = getopt(argc, argv, "p:n:c:w:k:z:h:l:s:o:")) != -1) {
+        switch (opt) {
+            case 'p':
+                break;
+            case 'n':
+                params.n_sectors = atoi(optarg);
+                break;
+            case 'c':
+                params.cols = atoi(optarg);
+                break;
+            case 'w':
+                params.walls = atoi(optarg);
+                break;
+            case 'k':
+                params.connectivity = atof(optarg);
+                break;
+            case 'z':
+                params.height_var = atof(optarg);
+                break;
+            case 'h':
+                params.room_height = atof(optarg);
+                break;
+            case 'l':
+                params.n_lights = atoi(optarg);
+                break;
+            case 's':
+                seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'o':
+                prefix = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-p corridor|city|cathedral] [-n SECTORS] [-c COLUMNS] [-w WALLS] [-k CONNECTIVITY] [-z HEIGHT_VARIATION] [-h ROOM_HEIGHT] [-l LIGHTS] [-s SEED] [-o PREFIX]\n", argv[0]);
+                exit(1);
+        }
+    }
+
+    if (params.n_sectors < 1 || params.n_sectors > MAX_SECTORS) {
+        fprintf(stderr, "Error: the number of sectors must be between 1 and %d\n", MAX_SECTORS);
+        exit(1);
+    }
+    if (params.room_height <= 0.0 || params.n_lights < 0) {
+        fprintf(stderr, "Error: invalid room height or light count\n");
+        exit(1);
+    }
+
+    // the files are named after the preset unless a prefix is given
+    char map_path[256], lights_path[256], manifest_path[256];
+    if (prefix == NULL) {
+        prefix = params.name;
+    }
+    snprintf(map_path, sizeof(map_path), "%s.txt", prefix);
+    snprintf(lights_path, sizeof(lights_path), "%slights.txt", prefix);
+    snprintf(manifest_path, sizeof(manifest_path), "%smanifest.txt", prefix);
+    if (!write_map(map_path, &params, seed)
+    || !write_lights(lights_path, &params, seed)
+    || !write_manifest(manifest_path, map_path, lights_path, &params)) {
+        exit(1);
+    }
+    printf("Wrote a %s map of %d sectors to %s\n", params.name, params.n_sectors, manifest_path);
+    return 0;
+}